@@ -0,0 +1,297 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <ostream>
+#include <iomanip>
+#include "symboltable.hpp"
+
+/* Aggregations over field expressions - `f` or `f1*f2` - for `agg <func> <start> <end> <symbol> <expr> [<expr>]`.
+ * A query is compiled once into an AggPlan (functions & field ids resolved), each table it touches then gets the kernel
+ * instantiated for its expression shape. The kernel makes one pass over the range: presence bitmap words decide which rows
+ * count, fully populated words run a branch free 4 lane loop updating every moment at once. Sums are kept shifted by the
+ * first value seen, so variance & covariance don't cancel catastrophically on prices far from zero.
+ */
+enum class AggFunc
+{
+    sum,
+    mean,
+    min,
+    max,
+    count,
+    variance,                                                                   //sample (n-1) flavour, as is covariance
+    covariance
+};
+
+struct Moments                                                                  //everything any AggFunc needs, mergeable across tables
+{
+    uint64_t count{0};
+    bool shifted{false};
+    double shiftX{0}, shiftY{0};
+    double sumX{0}, sumXX{0}, sumY{0}, sumXY{0};                                //of the shifted values
+    double minX{std::numeric_limits<double>::infinity()};
+    double maxX{-std::numeric_limits<double>::infinity()};
+};
+
+struct FieldExpr
+{
+    const Column* col;
+    size_t length() const { return col->values.size(); }
+    uint64_t mask(size_t word) const { return col->present[word]; }
+    double operator()(size_t row) const { return col->values[row]; }
+};
+
+struct ProductExpr
+{
+    const Column* a;
+    const Column* b;
+    size_t length() const { return min(a->values.size(), b->values.size()); }
+    uint64_t mask(size_t word) const { return a->present[word] & b->present[word]; }
+    double operator()(size_t row) const { return a->values[row]*b->values[row]; }
+};
+
+template<typename Expr, typename Dense, typename Sparse>
+void scanRange(const Expr& expr, size_t length, Range range, Dense&& dense, Sparse&& sparse)   //dense(first row of a full word), sparse(row)
+{
+    auto rowEnd = min<size_t>(range.second, length);
+    for(size_t row = range.first; row < rowEnd; )
+    {
+        auto word = row >> 6;
+        auto wordEnd = min<size_t>((word + 1) << 6, rowEnd);
+        auto mask = expr.mask(word);
+        mask &= ~uint64_t{0} << (row & 63);
+        if(wordEnd & 63)
+            mask &= ~(~uint64_t{0} << (wordEnd & 63));
+        if(mask == ~uint64_t{0})
+            dense(word << 6);
+        else
+            for(; mask; mask &= mask - 1)
+                sparse((word << 6) + __builtin_ctzll(mask));
+        row = wordEnd;
+    }
+}
+
+template<typename Expr>
+size_t firstRow(const Expr& expr, size_t length, Range range)                   //first row in range the expression has a value on, length if none
+{
+    auto rowEnd = min<size_t>(range.second, length);
+    for(size_t row = range.first; row < rowEnd; row = (row | 63) + 1)
+    {
+        auto mask = expr.mask(row >> 6) & (~uint64_t{0} << (row & 63));
+        if(mask)
+            return min<size_t>((row & ~size_t{63}) + __builtin_ctzll(mask), length);
+    }
+    return length;
+}
+
+template<typename X>
+void accumulateMoments(Moments& m, const X& x, Range range)
+{
+    if(!m.shifted)                                                              //first value seen becomes the shift
+    {
+        auto row = firstRow(x, x.length(), range);
+        if(row >= min<size_t>(range.second, x.length()))
+            return;
+        m.shiftX = x(row);
+        m.shifted = true;
+    }
+    double sum[4] = {}, sumSq[4] = {}, lo[4], hi[4];
+    for(auto lane = 0; lane < 4; ++lane)
+    {
+        lo[lane] = m.minX;
+        hi[lane] = m.maxX;
+    }
+    uint64_t count{0};
+    auto shift = m.shiftX;
+    scanRange(x, x.length(), range,
+        [&](size_t first){
+            for(auto row = first; row < first + 64; row += 4)
+                for(auto lane = 0; lane < 4; ++lane)                            //independent lanes - no loop carried dependency between them
+                {
+                    auto value = x(row + lane);
+                    auto delta = value - shift;
+                    sum[lane] += delta;
+                    sumSq[lane] += delta*delta;
+                    lo[lane] = value < lo[lane] ? value : lo[lane];
+                    hi[lane] = value > hi[lane] ? value : hi[lane];
+                }
+            count += 64;
+        },
+        [&](size_t row){
+            auto value = x(row);
+            auto delta = value - shift;
+            sum[0] += delta;
+            sumSq[0] += delta*delta;
+            lo[0] = min(lo[0], value);
+            hi[0] = max(hi[0], value);
+            ++count;
+        });
+    m.count += count;
+    m.sumX += (sum[0] + sum[1]) + (sum[2] + sum[3]);
+    m.sumXX += (sumSq[0] + sumSq[1]) + (sumSq[2] + sumSq[3]);
+    m.minX = min(min(lo[0], lo[1]), min(lo[2], lo[3]));
+    m.maxX = max(max(hi[0], hi[1]), max(hi[2], hi[3]));
+}
+
+template<typename X, typename Y>
+void accumulateMoments(Moments& m, const X& x, const Y& y, Range range)        //co-moments of two expressions over the rows carrying both
+{
+    struct Both
+    {
+        const X& x;
+        const Y& y;
+        uint64_t mask(size_t word) const { return x.mask(word) & y.mask(word); }
+    } both{x, y};
+    auto length = min(x.length(), y.length());
+    if(!m.shifted)
+    {
+        auto row = firstRow(both, length, range);
+        if(row >= min<size_t>(range.second, length))
+            return;
+        m.shiftX = x(row);
+        m.shiftY = y(row);
+        m.shifted = true;
+    }
+    double sumX[4] = {}, sumY[4] = {}, sumXY[4] = {};
+    uint64_t count{0};
+    auto shiftX = m.shiftX, shiftY = m.shiftY;
+    scanRange(both, length, range,
+        [&](size_t first){
+            for(auto row = first; row < first + 64; row += 4)
+                for(auto lane = 0; lane < 4; ++lane)
+                {
+                    auto dx = x(row + lane) - shiftX;
+                    auto dy = y(row + lane) - shiftY;
+                    sumX[lane] += dx;
+                    sumY[lane] += dy;
+                    sumXY[lane] += dx*dy;
+                }
+            count += 64;
+        },
+        [&](size_t row){
+            auto dx = x(row) - shiftX;
+            auto dy = y(row) - shiftY;
+            sumX[0] += dx;
+            sumY[0] += dy;
+            sumXY[0] += dx*dy;
+            ++count;
+        });
+    m.count += count;
+    m.sumX += (sumX[0] + sumX[1]) + (sumX[2] + sumX[3]);
+    m.sumY += (sumY[0] + sumY[1]) + (sumY[2] + sumY[3]);
+    m.sumXY += (sumXY[0] + sumXY[1]) + (sumXY[2] + sumXY[3]);
+}
+
+class AggPlan                                                                   //a compiled `agg` query - built once, run over every table the range touches
+{
+public:
+    static bool compile(const string& func, const vector<string>& exprs, const Interner& fields, AggPlan& plan)
+    {
+        static const vector<pair<string, AggFunc>> FUNCS = {{"sum", AggFunc::sum}, {"mean", AggFunc::mean}, {"min", AggFunc::min},
+                                                            {"max", AggFunc::max}, {"count", AggFunc::count},
+                                                            {"variance", AggFunc::variance}, {"covariance", AggFunc::covariance}};
+        auto funcIt = find_if(FUNCS.begin(), FUNCS.end(), [&](const pair<string, AggFunc>& entry){ return entry.first == func; });
+        if(funcIt == FUNCS.end())
+            return false;
+        plan = AggPlan{};
+        plan.func = funcIt->second;
+        if(exprs.size() != (plan.func == AggFunc::covariance ? 2u : 1u))
+            return false;
+        for(const auto& expr : exprs)
+        {
+            auto star = expr.find('*');
+            auto first = expr.substr(0, star);
+            auto second = star == string::npos ? string{} : expr.substr(star + 1);
+            if(first.empty() || ((star != string::npos) && (second.empty() || (second.find('*') != string::npos))))
+                return false;
+            plan.terms.push_back({fields.find(first), star == string::npos ? NO_FACTOR : fields.find(second)});
+        }
+        return true;
+    }
+    vector<unsigned> fieldIds() const                                           //the columns a run reads
+    {
+        vector<unsigned> ids;
+        for(const auto& term : terms)
+        {
+            ids.push_back(term.first);
+            if(term.second != NO_FACTOR)
+                ids.push_back(term.second);
+        }
+        return ids;
+    }
+    unsigned rollupField() const                                                //the field a rollup's count/sum/min/max answer this from, NONE if they can't
+    {
+        auto additive = (func != AggFunc::variance) && (func != AggFunc::covariance);
+        return (additive && (terms.size() == 1) && (terms[0].second == NO_FACTOR)) ? terms[0].first : Interner::NONE;
+    }
+    void run(Moments& m, const SymbolTable& table, Range range) const
+    {
+        if(terms.size() == 1)
+        {
+            if(!bound(table, terms[0]))                                         //a field this table never had - no rows count
+                return;
+            if(terms[0].second == NO_FACTOR)
+                accumulateMoments(m, FieldExpr{table.column(terms[0].first)}, range);
+            else
+                accumulateMoments(m, ProductExpr{table.column(terms[0].first), table.column(terms[0].second)}, range);
+            return;
+        }
+        if(!bound(table, terms[0]) || !bound(table, terms[1]))
+            return;
+        auto x = terms[0], y = terms[1];
+        if((x.second == NO_FACTOR) && (y.second == NO_FACTOR))
+            accumulateMoments(m, FieldExpr{table.column(x.first)}, FieldExpr{table.column(y.first)}, range);
+        else if(x.second == NO_FACTOR)
+            accumulateMoments(m, FieldExpr{table.column(x.first)}, ProductExpr{table.column(y.first), table.column(y.second)}, range);
+        else if(y.second == NO_FACTOR)
+            accumulateMoments(m, ProductExpr{table.column(x.first), table.column(x.second)}, FieldExpr{table.column(y.first)}, range);
+        else
+            accumulateMoments(m, ProductExpr{table.column(x.first), table.column(x.second)},
+                          ProductExpr{table.column(y.first), table.column(y.second)}, range);
+    }
+    void print(ostream& out, const Moments& m) const                            //same fixed 3 decimals as product, nan where it's undefined
+    {
+        double result{NAN};
+        switch(func)
+        {
+        case AggFunc::count:
+            out << m.count << "\n";
+            return;
+        case AggFunc::sum:
+            result = m.sumX + m.shiftX * m.count;
+            break;
+        case AggFunc::mean:
+            result = m.count ? m.shiftX + m.sumX / m.count : NAN;
+            break;
+        case AggFunc::min:
+            result = m.count ? m.minX : NAN;
+            break;
+        case AggFunc::max:
+            result = m.count ? m.maxX : NAN;
+            break;
+        case AggFunc::variance:
+            result = m.count > 1 ? (m.sumXX - m.sumX * m.sumX / m.count) / (m.count - 1) : NAN;
+            break;
+        case AggFunc::covariance:
+            result = m.count > 1 ? (m.sumXY - m.sumX * m.sumY / m.count) / (m.count - 1) : NAN;
+            break;
+        }
+        if(std::isnan(result))
+            out << "nan\n";
+        else
+            out << std::fixed << std::setprecision(3) << result << "\n";
+    }
+private:
+    enum : unsigned { NO_FACTOR = ~0u - 1u };                                   //second id of a single field term
+    static bool bound(const SymbolTable& table, pair<unsigned, unsigned> term)
+    {
+        if((term.first == Interner::NONE) || (term.second == Interner::NONE))
+            return false;
+        return table.column(term.first) && ((term.second == NO_FACTOR) || table.column(term.second));
+    }
+
+    AggFunc func{AggFunc::sum};
+    vector<pair<unsigned, unsigned>> terms;                                     //field ids, second is NO_FACTOR for a plain field
+};
@@ -0,0 +1,106 @@
+#pragma once
+#include <string>
+#include <sstream>
+#include <deque>
+#include <future>
+#include <chrono>
+#include "parser.hpp"
+#include "threads.hpp"
+
+struct BatchStats
+{
+    size_t queries{0};
+    size_t outputBytes{0};
+    double seconds{0};                                                          //spent on queries
+    double loadSeconds{0};                                                      //spent on tickfile barriers
+};
+
+/* Non-interactive driver: one command per line, print/product queries run concurrently on a pool while their results are
+ * emitted strictly in input order through one buffered writer. A tickfile line is a barrier - everything before it gets
+ * finished first, everything after it sees the new data.
+ */
+class BatchRunner
+{
+public:
+    BatchRunner(Parser& target, ostream& output, unsigned threads = defaultThreadCount())
+        : parser(target), out(output), pool(threads){};
+    BatchStats run(istream& in)
+    {
+        auto start = chrono::steady_clock::now();
+        string line, cmd, sym, f1, f2, file;
+        time_t s, e;
+        for(size_t lineNo = 1; getline(in, line); ++lineNo)
+        {
+            stringstream inputStr(line);
+            if(!(inputStr >> cmd))
+                continue;
+            if((cmd == "print") && (inputStr >> s >> e >> sym))
+            {
+                submit([this, s, e, sym](ostream& result){ parser.print(s, e, sym, result); });
+            }
+            else if((cmd == "product") && (inputStr >> s >> e >> sym >> f1 >> f2))
+            {
+                string total;
+                if((inputStr >> total) && (total == "total"))                   //grand total over a symbol set
+                    submit([this, s, e, sym, f1, f2](ostream& result){ parser.product(s, e, sym, f1, f2, true, result); });
+                else
+                    submit([this, s, e, sym, f1, f2](ostream& result){ parser.product(s, e, sym, f1, f2, result); });
+            }
+            else if((cmd == "tickfile") && (inputStr >> file))
+            {
+                drain();
+                auto loadStart = chrono::steady_clock::now();
+                if(!parser.openTickFile(file))
+                    cerr << "batch line " << lineNo << ": could not open \"" << file << "\"\n";
+                stats.loadSeconds += chrono::duration<double>(chrono::steady_clock::now() - loadStart).count();
+            }
+            else
+                cerr << "batch line " << lineNo << ": nope \n";
+        }
+        drain();
+        flush();
+        stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count() - stats.loadSeconds;
+        return stats;
+    }
+private:
+    static constexpr size_t MAX_IN_FLIGHT = 1024u;                              //bounds the memory held by finished but not yet emitted results
+    static constexpr size_t FLUSH_BYTES = 1u << 20;
+    template<typename Query>
+    void submit(Query query)
+    {
+        if(pending.size() >= MAX_IN_FLIGHT)
+            emitFront();
+        pending.push_back(pool.submit([query](){
+            ostringstream result;
+            query(result);
+            return result.str();
+        }));
+        ++stats.queries;
+    }
+    void emitFront()
+    {
+        buffer += pending.front().get();
+        pending.pop_front();
+        if(buffer.size() >= FLUSH_BYTES)
+            flush();
+    }
+    void drain()
+    {
+        while(!pending.empty())
+            emitFront();
+    }
+    void flush()
+    {
+        out.write(buffer.data(), buffer.size());
+        out.flush();
+        stats.outputBytes += buffer.size();
+        buffer.clear();
+    }
+
+    Parser& parser;
+    ostream& out;
+    ThreadPool pool;
+    deque<future<string>> pending;
+    string buffer;
+    BatchStats stats{};
+};
@@ -0,0 +1,177 @@
+#include <chrono>
+#include <fstream>
+#include <streambuf>
+#include "parser.hpp"
+#include "tickgen.hpp"
+
+using namespace std;
+
+/* Benchmarks over a seeded generated tick file - ingest MB/s, print & product rows/s and range lookup latency, reported as
+ * JSON so runs of different versions can be diffed. Every figure is the median of --reps runs.
+ */
+namespace
+{
+class NullBuffer : public streambuf                                             //swallows the output, only counts it
+{
+public:
+    size_t bytes{0};
+protected:
+    int overflow(int c) override
+    {
+        ++bytes;
+        return c;
+    }
+    streamsize xsputn(const char*, streamsize count) override
+    {
+        bytes += static_cast<size_t>(count);
+        return count;
+    }
+};
+
+struct RangeProbe : Parser                                                      //the lookups alone, without any query on top of them
+{
+    using Parser::findTable;
+    using Parser::findRange;
+};
+
+template<typename Func>
+double medianSeconds(unsigned reps, Func&& func)
+{
+    vector<double> times;
+    for(auto rep = 0u; rep < reps; ++rep)
+    {
+        auto start = chrono::steady_clock::now();
+        func();
+        times.push_back(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    }
+    sort(times.begin(), times.end());
+    return max(times[times.size() / 2], 1e-9);
+}
+
+struct Result
+{
+    string name;
+    string parser;
+    double value;
+    string unit;
+};
+} //eof anon namespace
+
+int main(int argc, char **argv)
+{
+    TickGenConfig config{};
+    config.bytes = 64u << 20;
+    unsigned reps{5}, ingestThreads{0}, lookups{100000};
+    string dataFile{"bench.dat"}, jsonFile{};
+    for(auto i = 1; i < argc; ++i)
+    {
+        string param = argv[i];
+        if(i + 1 >= argc)
+        {
+            cerr << "Missing value for " << param << ". Terminating." << endl;
+            return 1;
+        }
+        string value = argv[++i];
+        if(param == "--mib")
+            config.bytes = stoull(value) << 20;
+        else if(param == "--symbols")
+            config.symbols = max(1u, static_cast<unsigned>(stoul(value)));
+        else if(param == "--fields")
+            config.fields = max(2u, static_cast<unsigned>(stoul(value)));
+        else if(param == "--density")
+            config.fieldDensity = stod(value);
+        else if(param == "--seed")
+            config.seed = stoull(value);
+        else if(param == "--reps")
+            reps = max(1u, static_cast<unsigned>(stoul(value)));
+        else if(param == "--threads")
+            ingestThreads = static_cast<unsigned>(stoul(value));
+        else if(param == "--lookups")
+            lookups = max(1u, static_cast<unsigned>(stoul(value)));
+        else if(param == "--data")
+            dataFile = value;
+        else if(param == "--json")
+            jsonFile = value;
+        else
+        {
+            cerr << "Unrecognized parameter " << param << ". Terminating." << endl;
+            return 1;
+        }
+    }
+
+    size_t lines, fileBytes;
+    {
+        ofstream out(dataFile, ios::out | ios::trunc | ios::binary);
+        lines = generateTicks(out, config);
+        fileBytes = static_cast<size_t>(out.tellp());
+        if(!out)
+        {
+            cerr << "Cannot write " << dataFile << ". Terminating." << endl;
+            return 1;
+        }
+    }
+    vector<Result> results;
+
+    RangeProbe probe{};
+    probe.setIngestThreads(ingestThreads);
+    auto ingestSeconds = medianSeconds(reps, [&](){
+        RangeProbe fresh{};
+        fresh.setIngestThreads(ingestThreads);
+        fresh.openTickFile(dataFile);
+    });
+    results.push_back({"ingest", "Parser", fileBytes / ingestSeconds / 1e6, "MB/s"});
+    probe.openTickFile(dataFile);
+    auto table = probe.findTable("s0");
+    if(!table)
+    {
+        cerr << "No rows for s0 - file too small. Terminating." << endl;
+        return 1;
+    }
+    auto first = table->timestamps.front(), last = table->timestamps.back() + 1;
+    auto rows = static_cast<double>(table->size());
+
+    NullBuffer sink;
+    ostream null(&sink);
+    PrintParser printParser{};
+    ProductParser productParser{};
+    printParser.openTickFile(dataFile);
+    productParser.openTickFile(dataFile);
+    results.push_back({"print", "Parser", rows / medianSeconds(reps, [&](){ probe.print(first, last, "s0", null); }), "rows/s"});
+    results.push_back({"print", "PrintParser", rows / medianSeconds(reps, [&](){ printParser.print(first, last, "s0", null); }), "rows/s"});
+    results.push_back({"product", "Parser", rows / medianSeconds(reps, [&](){ probe.product(first, last, "s0", "f0", "f1", null); }), "rows/s"});
+    results.push_back({"product", "ProductParser", rows / medianSeconds(reps, [&](){ productParser.product(first, last, "s0", "f0", "f1", null); }), "rows/s"});
+
+    mt19937_64 engine(config.seed);
+    vector<pair<time_t, time_t>> ranges(lookups);
+    for(auto& range : ranges)                                                   //random windows inside the symbol's time span
+    {
+        auto a = first + static_cast<time_t>(engine() % static_cast<uint64_t>(last - first));
+        auto b = first + static_cast<time_t>(engine() % static_cast<uint64_t>(last - first));
+        range = {min(a, b), max(a, b) + 1};
+    }
+    size_t checksum{0};                                                         //keeps the lookups from being optimized away
+    auto lookupSeconds = medianSeconds(reps, [&](){
+        for(const auto& range : ranges)
+            checksum += probe.findRange(*table, range.first, range.second).first;
+    });
+    results.push_back({"range_lookup", "Parser", lookupSeconds / lookups * 1e9, "ns"});
+
+    ofstream jsonOut;
+    if(!jsonFile.empty())
+        jsonOut.open(jsonFile, ios::out | ios::trunc);
+    ostream& json = jsonFile.empty() ? cout : jsonOut;
+    json << "{\n  \"version\": 1,\n"
+         << "  \"config\": {\"bytes\": " << fileBytes << ", \"lines\": " << lines << ", \"symbols\": " << config.symbols
+         << ", \"fields\": " << config.fields << ", \"density\": " << config.fieldDensity << ", \"seed\": " << config.seed
+         << ", \"reps\": " << reps << ", \"ingest_threads\": " << ingestThreads << ", \"rows_s0\": " << table->size()
+         << ", \"lookups\": " << lookups << ", \"hardware_threads\": " << defaultThreadCount() << "},\n"
+         << "  \"results\": [\n";
+    for(auto i = 0u; i < results.size(); ++i)
+        json << "    {\"benchmark\": \"" << results[i].name << "\", \"parser\": \"" << results[i].parser << "\", \"value\": "
+             << std::fixed << std::setprecision(3) << results[i].value << ", \"unit\": \"" << results[i].unit << "\"}"
+             << (i + 1 < results.size() ? ",\n" : "\n");
+    json << "  ]\n}\n";
+    cerr << "lookup checksum " << checksum << ", " << sink.bytes << " bytes printed" << endl;
+    remove(dataFile.c_str());
+    return 0;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <utility>
+#include <glob.h>
+#include "symboltable.hpp"
+
+/* A segment is one tick file loaded on its own - typically one day. Its tables are indexed by the global symbol id and its
+ * columns by the global field id, so queries resolve names once for all segments. Every symbol carries its time bounds,
+ * a query skips the segments whose bounds can't intersect [start, end) without looking at a single row.
+ */
+struct Segment
+{
+    string file;
+    time_t minTime{0};                                                          //over all symbols, segments are kept sorted on it
+    time_t maxTime{0};
+    vector<SymbolTable> tables;
+    vector<pair<time_t, time_t>> bounds;                                        //per symbol id - min & max timestamp
+    const SymbolTable* table(unsigned symbolId, time_t startTime, time_t endTime) const    //null if it can't have rows in the range
+    {
+        if((symbolId >= tables.size()) || (tables[symbolId].size() == 0))
+            return nullptr;
+        if((bounds[symbolId].second < startTime) || (bounds[symbolId].first >= endTime))
+            return nullptr;
+        return &tables[symbolId];
+    }
+};
+
+inline vector<string> expandGlob(const string& pattern)                        //matches in glob's (sorted) order, none if nothing matches
+{
+    glob_t matches{};
+    vector<string> files;
+    if(glob(pattern.c_str(), 0, nullptr, &matches) == 0)
+        files.assign(matches.gl_pathv, matches.gl_pathv + matches.gl_pathc);
+    globfree(&matches);
+    return files;
+}
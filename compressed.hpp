@@ -0,0 +1,322 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include "symboltable.hpp"
+
+/* Compressed storage of one symbol's rows, cut into blocks of BLOCK rows - only the last block may be partial.
+ * Per block: min/max timestamp in the header, the timestamps as zigzag varint deltas, and per field a presence bitmap plus
+ * the present values Gorilla-style: XOR against the previous value, control bits say whether the meaningful bits fit the
+ * previous leading/trailing zero window. No NaN padding is stored at all. A range query decodes only the blocks it touches,
+ * into an ordinary SymbolTable of at most BLOCK rows, so the row level code is shared with the raw tables. Blocks never
+ * change once encoded, copies of a table share them - appending re-encodes the partial tail block only.
+ */
+class BitWriter
+{
+public:
+    explicit BitWriter(vector<uint64_t>& target) : words(target){};
+    void put(uint64_t value, unsigned bits)                                     //lowest 'bits' bits of value, 1..64
+    {
+        if(bits < 64)
+            value &= (uint64_t{1} << bits) - 1;
+        if(used == 0)
+            words.push_back(0u);
+        words.back() |= value << used;
+        if(used + bits > 64)
+            words.push_back(value >> (64 - used));
+        used = (used + bits) & 63;
+    }
+private:
+    vector<uint64_t>& words;
+    unsigned used{0};                                                           //bits taken in the last word, 0 - start a new one
+};
+
+class BitReader
+{
+public:
+    explicit BitReader(const uint64_t* source) : words(source){};
+    uint64_t get(unsigned bits)
+    {
+        auto word = pos >> 6, shift = pos & 63;
+        auto value = words[word] >> shift;
+        if(shift + bits > 64)
+            value |= words[word + 1] << (64 - shift);
+        pos += bits;
+        return bits < 64 ? value & ((uint64_t{1} << bits) - 1) : value;
+    }
+private:
+    const uint64_t* words;
+    size_t pos{0};
+};
+
+class PackedTable
+{
+public:
+    static constexpr size_t BLOCK = TimeIndex::BLOCK;
+    size_t size() const
+    {
+        return rows;
+    }
+    time_t lastTime() const                                                     //of the last row
+    {
+        return backTime;
+    }
+    size_t blockCount() const
+    {
+        return blocks.size();
+    }
+    size_t bytes() const                                                        //heap bytes held, headers included
+    {
+        auto total = blocks.capacity() * sizeof(shared_ptr<const Block>);
+        for(const auto& shared : blocks)
+        {
+            const auto& block = *shared;
+            total += sizeof(Block) + block.times.capacity() + block.columns.capacity() * sizeof(PackedColumn);
+            for(const auto& column : block.columns)
+                total += (column.present.capacity() + column.bits.capacity()) * sizeof(uint64_t);
+        }
+        return total;
+    }
+    void append(SymbolTable& raw)                                               //takes over raw's rows behind the packed ones, raw is left empty
+    {
+        if(raw.size() == 0)
+            return;
+        SymbolTable staged{};
+        const SymbolTable* source = &raw;
+        if(!blocks.empty() && (blocks.back()->rows < BLOCK))                     //partial tail gets re-encoded together with the new rows
+        {
+            decodeBlock(blocks.size() - 1, staged);
+            rows -= staged.size();
+            blocks.pop_back();
+            auto offset = staged.size();
+            staged.timestamps.insert(staged.timestamps.end(), raw.timestamps.begin(), raw.timestamps.end());
+            if(raw.columns.size() > staged.columns.size())
+                staged.columns.resize(raw.columns.size());
+            for(auto field = 0u; field < raw.columns.size(); ++field)
+                staged.columns[field].appendAt(offset, raw.columns[field]);
+            source = &staged;
+        }
+        if(rows == 0)
+            frontTime = source->timestamps.front();
+        for(size_t first = 0; first < source->size(); first += BLOCK)
+            encodeBlock(*source, first, min(first + BLOCK, source->size()));
+        backTime = source->timestamps.back();
+        raw = SymbolTable{};
+    }
+    void unpack(SymbolTable& raw) const                                         //the whole thing back into raw form
+    {
+        raw = SymbolTable{};
+        SymbolTable block{};
+        for(auto b = 0u; b < blocks.size(); ++b)
+        {
+            decodeBlock(b, block);
+            auto offset = raw.size();
+            raw.timestamps.insert(raw.timestamps.end(), block.timestamps.begin(), block.timestamps.end());
+            if(block.columns.size() > raw.columns.size())
+                raw.columns.resize(block.columns.size());
+            for(auto field = 0u; field < block.columns.size(); ++field)
+                raw.columns[field].appendAt(offset, block.columns[field]);
+        }
+        raw.index.update(raw.timestamps);
+    }
+    Range findRange(time_t startTime, time_t endTime) const                     //same answers as Parser::findRange over the raw rows
+    {
+        if(rows == 0)
+            return Range{0, 0};
+        auto rangeBeg = (startTime < frontTime ? 0u : firstNotBefore(startTime, 0u));
+        auto rangeEnd = (endTime > backTime ? rows : firstNotBefore(endTime, rangeBeg));
+        if((rangeBeg == rows) || (rangeBeg >= rangeEnd))
+            return Range{0, 0};
+        return Range{static_cast<unsigned>(rangeBeg), static_cast<unsigned>(rangeEnd)};
+    }
+    void decodeBlock(size_t b, SymbolTable& out, const vector<unsigned>* fields = nullptr) const   //fields - only those columns, all if null
+    {
+        const auto& block = *blocks[b];
+        decodeTimes(block, out.timestamps);
+        out.columns.assign(block.columns.size(), Column{});
+        auto decode = [&](unsigned field){
+            if(field >= block.columns.size() || block.columns[field].present.empty())
+                return;
+            decodeColumn(block.columns[field], out.columns[field]);
+        };
+        if(fields)
+            for(auto field : *fields)
+                decode(field);
+        else
+            for(auto field = 0u; field < block.columns.size(); ++field)
+                decode(field);
+    }
+private:
+    struct PackedColumn
+    {
+        vector<uint64_t> present;                                               //empty - the field has no value in the block
+        vector<uint64_t> bits;
+        uint32_t length{0};                                                     //rows up to the last present one, like Column::values.size()
+    };
+    struct Block
+    {
+        uint32_t rows{0};
+        time_t minTime{0};
+        time_t maxTime{0};
+        vector<uint8_t> times;
+        vector<PackedColumn> columns;
+    };
+
+    size_t firstNotBefore(time_t time, size_t from) const                       //mirrors TimeIndex::firstNotBefore, block by block
+    {
+        vector<time_t> times;
+        auto b = from / BLOCK;
+        if(sorted)
+        {
+            auto blockIt = lower_bound(blocks.begin() + min(b, blocks.size()), blocks.end(), time,
+                                       [](const shared_ptr<const Block>& block, time_t t){ return block->maxTime < t; });
+            if(blockIt == blocks.end())
+                return rows;
+            b = static_cast<size_t>(distance(blocks.begin(), blockIt));
+            decodeTimes(**blockIt, times);
+            auto first = max(from, b * BLOCK) - b * BLOCK;
+            return b * BLOCK + distance(times.begin(), lower_bound(times.begin() + first, times.end(), time));
+        }
+        for(; b < blocks.size(); ++b)
+        {
+            if(blocks[b]->maxTime < time)
+                continue;
+            decodeTimes(*blocks[b], times);
+            auto first = max(from, b * BLOCK) - b * BLOCK;
+            auto rowIt = find_if(times.begin() + first, times.end(), [&](time_t t){ return t >= time; });
+            if(rowIt != times.end())
+                return b * BLOCK + distance(times.begin(), rowIt);
+        }
+        return rows;
+    }
+    void encodeBlock(const SymbolTable& source, size_t first, size_t last)
+    {
+        Block block{};
+        block.rows = static_cast<uint32_t>(last - first);
+        block.minTime = block.maxTime = source.timestamps[first];
+        time_t previous{0};
+        for(auto row = first; row < last; ++row)
+        {
+            auto time = source.timestamps[row];
+            block.minTime = min(block.minTime, time);
+            block.maxTime = max(block.maxTime, time);
+            if(row > first)
+                sorted = sorted && (source.timestamps[row-1] <= time);
+            auto delta = static_cast<uint64_t>(time - previous);
+            auto zigzag = (delta << 1) ^ static_cast<uint64_t>(static_cast<int64_t>(delta) >> 63);
+            for(; zigzag >= 0x80; zigzag >>= 7)
+                block.times.push_back(static_cast<uint8_t>(zigzag | 0x80));
+            block.times.push_back(static_cast<uint8_t>(zigzag));
+            previous = time;
+        }
+        if(!blocks.empty())
+            sorted = sorted && (blocks.back()->maxTime <= block.minTime);
+        block.columns.resize(source.columns.size());
+        for(auto field = 0u; field < source.columns.size(); ++field)
+            encodeColumn(source.columns[field], first, last, block.columns[field]);
+        block.times.shrink_to_fit();
+        blocks.push_back(make_shared<const Block>(move(block)));
+        rows += last - first;
+    }
+    static void encodeColumn(const Column& source, size_t first, size_t last, PackedColumn& out)
+    {
+        vector<uint64_t> present((last - first + 63) / 64, 0u);
+        uint32_t length{0};
+        for(auto row = first; row < min(last, source.values.size()); ++row)
+            if(source.has(row))
+            {
+                present[(row - first) >> 6] |= uint64_t{1} << ((row - first) & 63);
+                length = static_cast<uint32_t>(row - first + 1);
+            }
+        if(length == 0)
+            return;
+        out.present = move(present);
+        out.length = length;
+        BitWriter writer(out.bits);
+        uint64_t previous{0};
+        unsigned leading{65}, trailing{0};                                      //65 - no window yet
+        for(auto row = first; row < first + length; ++row)
+        {
+            if(!source.has(row))
+                continue;
+            uint64_t value;
+            memcpy(&value, &source.values[row], sizeof(value));
+            auto xored = value ^ previous;
+            previous = value;
+            if(xored == 0)
+            {
+                writer.put(0u, 1);
+                continue;
+            }
+            auto lead = min(31u, static_cast<unsigned>(__builtin_clzll(xored)));
+            auto trail = static_cast<unsigned>(__builtin_ctzll(xored));
+            if((leading <= 64) && (lead >= leading) && (trail >= trailing))     //fits the previous window
+            {
+                writer.put(1u, 2);                                              //'1' then '0'
+                writer.put(xored >> trailing, 64 - leading - trailing);
+                continue;
+            }
+            auto meaningful = 64 - lead - trail;
+            writer.put(3u, 2);                                                  //'1' then '1'
+            writer.put(lead, 5);
+            writer.put(meaningful - 1, 6);
+            writer.put(xored >> trail, meaningful);
+            leading = lead;
+            trailing = trail;
+        }
+        out.bits.shrink_to_fit();
+    }
+    static void decodeTimes(const Block& block, vector<time_t>& times)
+    {
+        times.resize(block.rows);
+        time_t previous{0};
+        const auto* byte = block.times.data();
+        for(auto row = 0u; row < block.rows; ++row)
+        {
+            uint64_t zigzag{0};
+            for(unsigned shift = 0; ; shift += 7, ++byte)
+            {
+                zigzag |= static_cast<uint64_t>(*byte & 0x7f) << shift;
+                if(!(*byte & 0x80))
+                    break;
+            }
+            ++byte;
+            auto delta = static_cast<int64_t>((zigzag >> 1) ^ (~(zigzag & 1) + 1));
+            previous += static_cast<time_t>(delta);
+            times[row] = previous;
+        }
+    }
+    static void decodeColumn(const PackedColumn& packed, Column& out)
+    {
+        out.values.assign(packed.length, NAN);
+        out.present.assign((packed.length + 63) / 64, 0u);
+        copy(packed.present.begin(), packed.present.begin() + out.present.size(), out.present.begin());
+        BitReader reader(packed.bits.data());
+        uint64_t previous{0};
+        unsigned leading{0}, trailing{0};
+        for(auto word = 0u; word < out.present.size(); ++word)
+            for(auto mask = out.present[word]; mask; mask &= mask - 1)
+            {
+                auto row = (word << 6) + __builtin_ctzll(mask);
+                if(reader.get(1))
+                {
+                    if(reader.get(1))
+                    {
+                        leading = static_cast<unsigned>(reader.get(5));
+                        auto meaningful = static_cast<unsigned>(reader.get(6)) + 1;
+                        trailing = 64 - leading - meaningful;
+                    }
+                    previous ^= reader.get(64 - leading - trailing) << trailing;
+                }
+                memcpy(&out.values[row], &previous, sizeof(previous));
+            }
+    }
+
+    vector<shared_ptr<const Block>> blocks;                                     //shared with the copies of the table
+    size_t rows{0};
+    time_t frontTime{0};                                                        //first & last row, findRange shortcuts on them like the raw one
+    time_t backTime{0};
+    bool sorted{true};
+};
@@ -0,0 +1,55 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <utility>
+
+/* Copy-on-write slots for per symbol structures - each one behind a shared_ptr<const T>. Copying the whole vector copies
+ * pointers only, so two versions of the data share every slot neither of them changed since. Reads never copy anything;
+ * edit() hands out the slot for changing and copies it first if some other version still holds it. Slots are made through
+ * make_shared<T>, never as const objects, which is what lets edit() change a slot it owns alone.
+ */
+template<typename T>
+class CowVector
+{
+public:
+    size_t size() const
+    {
+        return slots.size();
+    }
+    bool empty() const
+    {
+        return slots.empty();
+    }
+    const T& operator[](size_t i) const
+    {
+        return *slots[i];
+    }
+    T& edit(size_t i)                                                           //the slot about to change - a private copy if it's shared
+    {
+        auto& slot = slots[i];
+        if(slot.use_count() > 1)                                                //only the writer of this version copies slots around, no race on the count
+            slot = std::make_shared<T>(*slot);
+        return const_cast<T&>(*slot);
+    }
+    void replace(size_t i, T&& value)                                           //a new slot, versions sharing the old one keep it
+    {
+        slots[i] = std::make_shared<T>(std::move(value));
+    }
+    void emplace_back()
+    {
+        slots.push_back(std::make_shared<T>());
+    }
+    void resize(size_t count)                                                   //new slots start out default constructed
+    {
+        slots.reserve(count);
+        while(slots.size() < count)
+            slots.push_back(std::make_shared<T>());
+        slots.resize(count);
+    }
+    void clear()
+    {
+        slots.clear();
+    }
+private:
+    std::vector<std::shared_ptr<const T>> slots;
+};
@@ -0,0 +1,37 @@
+#pragma once
+#include <string>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+
+/* Appends value the way `ostream << std::fixed << std::setprecision(3)` would print it (classic locale).
+ * value*1000 is rounded to an integer and printed by hand. The product carries at most half an ulp of error, so whenever it
+ * lands close to a .5 tie (or is too large for the error to be ignored) the job is left to snprintf to get the exact
+ * decimal rounding iostreams do - keeps the output byte identical.
+ */
+inline void appendFixed3(std::string& out, double value)
+{
+    auto scaled = value * 1000.0;
+    auto magnitude = std::fabs(scaled);
+    if(!(magnitude < 1e12) || (std::fabs(magnitude - std::floor(magnitude) - 0.5) < 1e-3))      //also catches nan & inf
+    {
+        char buf[512];                                                          //fits anything %.3f can print for a double
+        auto len = std::snprintf(buf, sizeof(buf), "%.3f", value);
+        out.append(buf, len);
+        return;
+    }
+    auto digits = static_cast<uint64_t>(std::llround(magnitude));
+    char buf[24];
+    auto pos = sizeof(buf);
+    for(auto i = 0; i < 3; ++i, digits /= 10)
+        buf[--pos] = static_cast<char>('0' + digits % 10);
+    buf[--pos] = '.';
+    do
+    {
+        buf[--pos] = static_cast<char>('0' + digits % 10);
+        digits /= 10;
+    } while(digits);
+    if(std::signbit(value))                                                     //-0.0001 prints as -0.000 with iostreams too
+        buf[--pos] = '-';
+    out.append(buf + pos, sizeof(buf) - pos);
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+/* Hands out dense ids (0, 1, 2... in order of first appearance) for names. intern() hashes the raw token exactly once for the
+ * lookup and the possible insert, and needs no std::string to do it - the one kept per name is only made on first sight.
+ * Open addressing with linear probing, the table is kept at most half full.
+ */
+class Interner
+{
+public:
+    enum : unsigned { NONE = ~0u };                                             //enum - usable by reference without an out of line definition
+
+    unsigned intern(const char* ptr, size_t len)
+    {
+        if(2 * (names.size() + 1) > slots.size())
+            grow();
+        auto hash = hashOf(ptr, len);
+        auto slot = probe(ptr, len, hash);
+        if(slots[slot] == 0)
+        {
+            names.emplace_back(ptr, len);
+            hashes.push_back(hash);
+            slots[slot] = static_cast<unsigned>(names.size());                  //0 marks an empty slot, so ids are stored off by one
+        }
+        return slots[slot] - 1;
+    }
+    unsigned intern(const std::string& name)
+    {
+        return intern(name.data(), name.size());
+    }
+    unsigned find(const std::string& name) const                                //NONE if never seen
+    {
+        if(slots.empty())
+            return NONE;
+        return slots[probe(name.data(), name.size(), hashOf(name.data(), name.size()))] - 1;
+    }
+    const std::string& name(unsigned id) const
+    {
+        return names[id];
+    }
+    const std::vector<std::string>& allNames() const
+    {
+        return names;
+    }
+    size_t size() const
+    {
+        return names.size();
+    }
+private:
+    static uint64_t hashOf(const char* ptr, size_t len)                         //FNV-1a, tokens are a handful of bytes
+    {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for(size_t i = 0; i < len; ++i)
+            hash = (hash ^ static_cast<unsigned char>(ptr[i])) * 0x100000001b3ull;
+        return hash;
+    }
+    size_t probe(const char* ptr, size_t len, uint64_t hash) const              //slot holding the name, or the empty one it would go to
+    {
+        auto mask = slots.size() - 1;
+        for(auto slot = hash & mask; ; slot = (slot + 1) & mask)
+        {
+            auto id = slots[slot];
+            if((id == 0) || ((hashes[id-1] == hash) && (names[id-1].size() == len) && (memcmp(names[id-1].data(), ptr, len) == 0)))
+                return slot;
+        }
+    }
+    void grow()
+    {
+        slots.assign(slots.empty() ? 64u : 2 * slots.size(), 0u);
+        auto mask = slots.size() - 1;
+        for(unsigned id = 0; id < names.size(); ++id)                           //stored hashes - no rehashing of the names
+        {
+            auto slot = hashes[id] & mask;
+            while(slots[slot] != 0)
+                slot = (slot + 1) & mask;
+            slots[slot] = id + 1;
+        }
+    }
+
+    std::vector<std::string> names;
+    std::vector<uint64_t> hashes;
+    std::vector<unsigned> slots;
+};
@@ -0,0 +1,106 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define GS_X86_KERNELS
+#endif
+
+/* Sum of a[r]*b[r] over the rows whose presence bits are set in both bitmaps - one AND per 64 rows decides which count.
+ * Runs of fully populated words go to a dense dot product with no per row test at all, the rest is picked bit by bit.
+ * Values are never looked at to tell missing from present, so a nan that came in the input makes it into the sum.
+ * The SIMD flavours of the dense dot are compiled for their target regardless of the compiler flags and the best one the
+ * cpu supports gets picked on first use.
+ */
+using DenseDotKernel = double (*)(const double*, const double*, size_t);
+
+inline double denseDotScalar(const double* a, const double* b, size_t count)
+{
+    double sum{0};
+    for(size_t i = 0; i < count; ++i)
+        sum += a[i]*b[i];
+    return sum;
+}
+
+#ifdef GS_X86_KERNELS
+__attribute__((target("sse2")))
+inline double denseDotSse2(const double* a, const double* b, size_t count)
+{
+    __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();                  //two accumulators hide the add latency
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+        acc1 = _mm_add_pd(acc1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+    return lanes[0] + lanes[1] + denseDotScalar(a + i, b + i, count - i);
+}
+
+__attribute__((target("avx2")))
+inline double denseDotAvx2(const double* a, const double* b, size_t count)
+{
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8)                                               //no fma on purpose - stays bit-close to the scalar path
+    {
+        acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + denseDotScalar(a + i, b + i, count - i);
+}
+#endif
+
+inline DenseDotKernel selectDenseDot()
+{
+#ifdef GS_X86_KERNELS
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return denseDotAvx2;
+    if(__builtin_cpu_supports("sse2"))
+        return denseDotSse2;
+#endif
+    return denseDotScalar;
+}
+
+inline double denseDot(const double* a, const double* b, size_t count)
+{
+    static const DenseDotKernel kernel = selectDenseDot();
+    return kernel(a, b, count);
+}
+
+inline double maskedDot(const double* a, const double* b, const uint64_t* presentA, const uint64_t* presentB, size_t first, size_t last)
+{
+    double sum{0};
+    auto runBeg = first, runEnd = first;                                        //[runBeg, runEnd) - full words not summed yet, runEnd is always the next row
+    for(auto row = first; row < last; )
+    {
+        auto word = row >> 6;
+        auto wordEnd = std::min<size_t>((word + 1) << 6, last);
+        auto mask = presentA[word] & presentB[word];
+        mask &= ~uint64_t{0} << (row & 63);
+        if(wordEnd & 63)
+            mask &= ~(~uint64_t{0} << (wordEnd & 63));
+        if(mask == ~uint64_t{0})                                                //the run grows, nothing summed yet
+            runEnd = wordEnd;
+        else
+        {
+            if(runBeg < runEnd)
+                sum += denseDot(a + runBeg, b + runBeg, runEnd - runBeg);
+            runBeg = runEnd = wordEnd;
+            for(; mask; mask &= mask - 1)
+            {
+                auto r = (word << 6) + __builtin_ctzll(mask);
+                sum += a[r]*b[r];
+            }
+        }
+        row = wordEnd;
+    }
+    if(runBeg < runEnd)
+        sum += denseDot(a + runBeg, b + runBeg, runEnd - runBeg);
+    return sum;
+}
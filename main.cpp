@@ -1,39 +1,63 @@
 #include <memory>
+#include <cstdlib>
+#include <unistd.h>
 #include "parser.hpp"
+#include "batch.hpp"
+#include "server.hpp"
+#include "schema.hpp"
 
 using namespace std;
 
 namespace
 {
 template<typename T>
-unique_ptr<IParser> parserFactory()
+unique_ptr<Parser> parserFactory()                                              //also builds the server versions, see server.hpp
 {
     return make_unique<T>();
 }
+
+GS_SCHEMA_FIELD(F0, "f0");                                                      //the feed's fields, in the order its lines carry them
+GS_SCHEMA_FIELD(F1, "f1");
+GS_SCHEMA_FIELD(F2, "f2");
+GS_SCHEMA_FIELD(F3, "f3");
+GS_SCHEMA_FIELD(F4, "f4");
+GS_SCHEMA_FIELD(F5, "f5");
+GS_SCHEMA_FIELD(F6, "f6");
+GS_SCHEMA_FIELD(F7, "f7");
+GS_SCHEMA_FIELD(F8, "f8");
+GS_SCHEMA_FIELD(F9, "f9");
+using FeedSchema = FieldSchema<F0, F1, F2, F3, F4, F5, F6, F7, F8, F9>;
 } //eof anon namespace
 
 int main(int argc, char **argv)
 {
-    unique_ptr<IParser> parser{nullptr};
+    unique_ptr<Parser> parser{nullptr};
+    string optimization, batchSource, socketPath;
+    size_t budgetMiB{0};
+    bool schema{false};
 
-    if(argc == 1)       //no optimization //boost::program_options would handle this more gracefuly
-    {
-        parser = parserFactory<Parser>();
-    }
-    else if(argc > 2){
-        cout << "Invalid parameter count \nTerminating." << endl;
-        return 0;
-    }
-    else
+    for(auto i = 1; i < argc; ++i)      //boost::program_options would handle this more gracefuly
     {
-        string param = argv[1];
-        if(param == "-Oprint")
+        string param = argv[i];
+        if((param == "-Oprint") || (param == "-Oproduct"))
+        {
+            optimization = param;
+        }
+        else if((param == "--batch") && (i + 1 < argc))  //file of commands, '-' for stdin
+        {
+            batchSource = argv[++i];
+        }
+        else if((param == "--serve") && (i + 1 < argc))  //unix domain socket path, see server.hpp
         {
-            parser = parserFactory<PrintParser>();              //TODO: actually implement this
+            socketPath = argv[++i];
         }
-        else if(param == "-Oproduct")
+        else if(param == "--schema")    //compiled in FeedSchema tokenizer, lines off the schema go the generic way, see schema.hpp
         {
-            parser = parserFactory<ProductParser>();            //TODO: actually implement this
+            schema = true;
+        }
+        else if((param == "--memory-budget") && (i + 1 < argc))  //MiB of raw tables kept in memory, the rest spills to disk, see paging.hpp
+        {
+            budgetMiB = strtoull(argv[++i], nullptr, 10);
         }
         else
         {
@@ -41,14 +65,75 @@ int main(int argc, char **argv)
             return 0;
         }
     }
+    if(optimization == "-Oprint")
+    {
+        parser = schema ? parserFactory<SchemaParser<FeedSchema, PrintParser>>() : parserFactory<PrintParser>();
+    }
+    else if(optimization == "-Oproduct")
+    {
+        parser = schema ? parserFactory<SchemaParser<FeedSchema, ProductParser>>() : parserFactory<ProductParser>();
+    }
+    else                //no optimization
+    {
+        parser = schema ? parserFactory<SchemaParser<FeedSchema>>() : parserFactory<Parser>();
+    }
+
+    if(budgetMiB)
+    {
+        auto tmpDir = getenv("TMPDIR");
+        auto spillPath = string(tmpDir && *tmpDir ? tmpDir : "/tmp") + "/gs_spill." + to_string(getpid());
+        if(!socketPath.empty() || !parser->setMemoryBudget(budgetMiB << 20, spillPath))  //server versions can't share one spill file
+        {
+            cout << "Cannot use a memory budget here. Terminating.";
+            return 0;
+        }
+    }
+    if(!socketPath.empty())
+    {
+        QueryServer server(optimization == "-Oprint" ? (schema ? parserFactory<SchemaParser<FeedSchema, PrintParser>> : parserFactory<PrintParser>)
+                           : optimization == "-Oproduct" ? (schema ? parserFactory<SchemaParser<FeedSchema, ProductParser>> : parserFactory<ProductParser>)
+                           : (schema ? parserFactory<SchemaParser<FeedSchema>> : parserFactory<Parser>));
+        if(!server.listen(socketPath))
+        {
+            cout << "Cannot listen on " << socketPath << ". Terminating.";
+            return 0;
+        }
+        cerr << "serving on " << socketPath << endl;
+        server.run();
+        return 0;
+    }
+    if(!batchSource.empty())
+    {
+        ifstream batchFile;
+        if(batchSource != "-")
+        {
+            batchFile.open(batchSource);
+            if(!batchFile)
+            {
+                cout << "Cannot open batch file. Terminating.";
+                return 0;
+            }
+        }
+        auto stats = BatchRunner(*parser, cout).run(batchSource == "-" ? cin : batchFile);
+        auto seconds = max(stats.seconds, 1e-9);
+        cerr << "batch: " << stats.queries << " queries in " << std::fixed << std::setprecision(3) << seconds << " s, "
+             << stats.queries / seconds << " queries/s, " << stats.outputBytes / seconds / 1e6 << " MB/s out (+"
+             << stats.loadSeconds << " s loading)" << endl;
+        return 0;
+    }
+    if(optimization == "-Oprint")
+        cout << "Parser for optimized printing operation selected" << endl;
+    else if(optimization == "-Oproduct")
+        cout << "Parser for optimized product operation selected" << endl;
 
-    string context = "Available commands: tickfile <file_name>";
-    string contextIfSelected = "/print <start time> <end time> <symbol>/product <start time> <end time> <symbol> <field1> <field2>";
+    string context = "Available commands: tickfile <file_name>/tickfiles <glob>/follow <file_name>/load <snapshot>";
+    string contextIfSelected = "/print <start time> <end time> <symbols>/product <start time> <end time> <symbols> <field1> <field2> [total]/prefixsums <MiB>/save <snapshot>/compress <on|off>/rollup <on [f1*f2 ...]|off>/unload <file_name>/agg <func> <start time> <end time> <symbol> <expr> [<expr>]/stats";
     string prompt = "$> ";
     bool isFileSelected = false;
     string cmd, file, currentFile;
     time_t s,e;
     string sym,f1,f2;
+    size_t mib;
     while(1)
     {
         string line;
@@ -69,10 +154,108 @@ int main(int argc, char **argv)
         {
             if(isFileSelected)
             {
-                inputStr >> s >> e >> sym >> f1 >> f2;
-                parser->product(s, e, sym, f1, f2);
+                string total;
+                inputStr >> s >> e >> sym >> f1 >> f2 >> total;
+                if(total == "total")                                    //grand total over a symbol set
+                    parser->product(s, e, sym, f1, f2, true, cout);
+                else
+                    parser->product(s, e, sym, f1, f2);
             }
         }
+        else if(cmd == "agg")                                   //sum|mean|min|max|count|variance|covariance over f or f1*f2, covariance takes two
+        {
+            string func, expr;
+            vector<string> exprs;
+            if(isFileSelected && (inputStr >> func >> s >> e >> sym))
+            {
+                while(inputStr >> expr)
+                    exprs.push_back(expr);
+                if(!parser->aggregate(s, e, sym, func, exprs))
+                    cout << prompt << " bad aggregate \"" << func << "\"\n";
+            }
+        }
+        else if(cmd == "prefixsums")                            //cached running products for repeated product queries, 0 MiB turns them off
+        {
+            if(isFileSelected && (inputStr >> mib))
+            {
+                parser->setPrefixSumBudget(mib << 20);
+            }
+        }
+        else if(cmd == "save")
+        {
+            if(isFileSelected && (inputStr >> file) && !parser->saveSnapshot(file))
+                cout << prompt << " could not write snapshot \"" << file << "\"\n";
+        }
+        else if(cmd == "load")
+        {
+            if(inputStr >> file)
+            {
+                if(parser->loadSnapshot(file))
+                {
+                    isFileSelected = true;
+                    currentFile = file;
+                }
+                else
+                    cout << prompt << " not a valid snapshot \"" << file << "\"\n";
+            }
+        }
+        else if(cmd == "compress")                              //on - delta/XOR packed blocks, off - raw columns
+        {
+            string mode;
+            if((inputStr >> mode) && ((mode == "on") || (mode == "off")))
+            {
+                parser->setCompressedStorage(mode == "on");
+                cout << prompt << " storage: " << parser->storageBytes() << " bytes\n";
+            }
+        }
+        else if(cmd == "rollup")                                //on [f1*f2 ...] - minute/hour/day buckets kept up to date on every load, off drops them
+        {
+            string mode, expr;
+            vector<pair<string, string>> pairs;
+            if((inputStr >> mode) && ((mode == "on") || (mode == "off")))
+            {
+                while(inputStr >> expr)
+                {
+                    auto star = expr.find('*');
+                    if(star != string::npos)
+                        pairs.push_back({expr.substr(0, star), expr.substr(star + 1)});
+                }
+                if(parser->setRollups(mode == "on", pairs))
+                    cout << prompt << " storage: " << parser->storageBytes() << " bytes\n";
+                else
+                    cout << prompt << " rollup refused - a field not loaded yet or a memory budget\n";
+            }
+        }
+        else if(cmd == "stats")                                 //ingest counters & phase times, print/product latency histograms
+        {
+            parser->printStats(cout);
+        }
+        else if(cmd == "follow")                                //picks up the lines appended since the last tickfile/follow of that file
+        {
+            if((inputStr >> file) && parser->followTickFile(file))
+            {
+                isFileSelected = true;
+                currentFile = file;
+            }
+        }
+        else if(cmd == "tickfiles")                             //glob - every file becomes its own time partitioned segment, loaded in parallel
+        {
+            if(inputStr >> file)
+            {
+                auto count = parser->openTickFiles(file);
+                cout << prompt << " " << count << " files loaded\n";
+                if(count)
+                {
+                    isFileSelected = true;
+                    currentFile = file;
+                }
+            }
+        }
+        else if(cmd == "unload")                                //drops the segment of one file loaded by tickfiles
+        {
+            if((inputStr >> file) && !parser->unloadTickFile(file))
+                cout << prompt << " no segment for \"" << file << "\"\n";
+        }
         else if(cmd == "tickfile")
         {
             inputStr >> file;
@@ -0,0 +1,78 @@
+#pragma once
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Read-only mapping of a regular file, from 'offset' to its current end. Anything that can't be mapped (pipes, character
+ * devices, missing files...) leaves the object invalid and the caller is expected to fall back to plain stream reading.
+ * An offset past the end maps nothing but stays valid - fileSize() tells what happened.
+ */
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string& fName, size_t offset = 0)
+    {
+        struct stat st;
+        if((::stat(fName.c_str(), &st) != 0) || !S_ISREG(st.st_mode))          //checked before opening - opening a fifo would block (and steal it from the fallback reader)
+            return;
+        fd = ::open(fName.c_str(), O_RDONLY);
+        if((fd < 0) || (::fstat(fd, &st) != 0))
+        {
+            release();
+            return;
+        }
+        totalSize = static_cast<size_t>(st.st_size);
+        if(offset < totalSize)                                                  //mmap refuses zero length mappings, an empty range is still a valid one though
+        {
+            auto aligned = offset & ~(static_cast<size_t>(::sysconf(_SC_PAGESIZE)) - 1);   //mapping offsets have to be page aligned
+            mappedLength = totalSize - aligned;
+            void* addr = ::mmap(nullptr, mappedLength, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(aligned));
+            if(addr == MAP_FAILED)
+            {
+                release();
+                return;
+            }
+            ::madvise(addr, mappedLength, MADV_SEQUENTIAL);                     //single forward pass - let the kernel read ahead aggressively
+            mapping = static_cast<const char*>(addr);
+            base = mapping + (offset - aligned);
+            length = totalSize - offset;
+        }
+        isValid = true;
+    }
+    ~MappedFile()
+    {
+        release();
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    explicit operator bool() const { return isValid; }
+    const char* data() const { return base; }
+    size_t size() const { return length; }                                      //bytes from the offset on
+    size_t fileSize() const { return totalSize; }
+private:
+    void release()
+    {
+        if(mapping)
+            ::munmap(const_cast<char*>(mapping), mappedLength);
+        if(fd >= 0)
+            ::close(fd);
+        mapping = nullptr;
+        base = nullptr;
+        mappedLength = 0;
+        length = 0;
+        totalSize = 0;
+        fd = -1;
+        isValid = false;
+    }
+
+    int fd{-1};
+    const char* mapping{nullptr};
+    size_t mappedLength{0};
+    const char* base{nullptr};
+    size_t length{0};
+    size_t totalSize{0};
+    bool isValid{false};
+};
@@ -0,0 +1,100 @@
+#pragma once
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <ctime>
+#include <string>
+
+/* Number parsing for the tick tokens without atoi/atof - no locale lookups and no copy of the token for the common shapes.
+ * Plain decimals with at most 15 significant digits and 22 fraction digits are exact: both the digits and the power of ten
+ * are representable as doubles, so the single division rounds correctly (Clinger's fast path) - same bits strtod gives.
+ * Anything else (exponents, inf/nan, long mantissas, whitespace, trailing junk) is handed to strtod/strtoll, so the result
+ * never differs from theirs.
+ */
+namespace numparse
+{
+constexpr size_t MAX_TOKEN = 63u;                                               //longer tokens are copied to the heap, never cut
+
+class Terminated                                                                //'\0' ended copy of a token for strtod/strtoll
+{
+public:
+    Terminated(const char* ptr, size_t len)
+    {
+        if(len > MAX_TOKEN)
+        {
+            heap.assign(ptr, len);
+            return;
+        }
+        std::memcpy(buf, ptr, len);
+        buf[len] = '\0';
+    }
+    const char* c_str() const
+    {
+        return heap.empty() ? buf : heap.c_str();
+    }
+private:
+    char buf[MAX_TOKEN + 1];
+    std::string heap;
+};
+
+inline time_t parseTime(const char* ptr, size_t len)                            //full 64 bit, unlike the atoi it replaces
+{
+    auto pos = size_t{0};
+    auto negative = (len > 0) && (ptr[0] == '-');
+    if(negative || ((len > 0) && (ptr[0] == '+')))
+        ++pos;
+    if((pos == len) || (len - pos > 18))                                        //18 digits can't overflow an int64
+    {
+        return static_cast<time_t>(std::strtoll(Terminated(ptr, len).c_str(), nullptr, 10));
+    }
+    int64_t value{0};
+    for(; pos < len; ++pos)
+    {
+        auto digit = static_cast<unsigned>(ptr[pos] - '0');
+        if(digit > 9)
+        {
+            return static_cast<time_t>(std::strtoll(Terminated(ptr, len).c_str(), nullptr, 10));
+        }
+        value = value * 10 + digit;
+    }
+    return static_cast<time_t>(negative ? -value : value);
+}
+
+inline double parseDecimal(const char* ptr, size_t len)
+{
+    static const double POW10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    auto pos = size_t{0};
+    auto negative = (len > 0) && (ptr[0] == '-');
+    if(negative || ((len > 0) && (ptr[0] == '+')))
+        ++pos;
+    uint64_t mantissa{0};
+    unsigned digits{0}, significant{0}, scale{0};
+    auto dot = false;
+    for(; pos < len; ++pos)
+    {
+        auto c = ptr[pos];
+        auto digit = static_cast<unsigned>(c - '0');
+        if(digit <= 9)
+        {
+            ++digits;
+            if(significant || digit)                                            //leading zeros don't count towards the 15
+                ++significant;
+            mantissa = mantissa * 10 + digit;
+            scale += dot;
+            if(significant > 15)
+                break;
+        }
+        else if((c == '.') && !dot)
+            dot = true;
+        else
+            break;
+    }
+    if((pos != len) || (digits == 0) || (scale > 22))
+    {
+        return std::strtod(Terminated(ptr, len).c_str(), nullptr);
+    }
+    auto value = static_cast<double>(mantissa) / POW10[scale];
+    return negative ? -value : value;
+}
+} //eof numparse namespace
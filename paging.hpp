@@ -0,0 +1,322 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <mutex>
+#include <sstream>
+#include <limits>
+#include <fcntl.h>
+#include <unistd.h>
+#include "symboltable.hpp"
+#include "snapshot.hpp"
+
+/* Out-of-core mode - the raw tables are held to a memory budget. Once the tables in memory outgrow it, the least recently
+ * used symbols spill to one append-only columnar file (snapshot's per table layout) and their memory goes back. A spilled
+ * symbol keeps only the rows appended since in memory, the tail; a query pages the whole table back in - chunks in order,
+ * the tail behind them - and pins it while reading. Rows already on disk are never written twice, so evicting a symbol
+ * that only got queried since is free. A symbol reordered after a spill leaves its chunks dead, once they outweigh the
+ * live ones the live chunks get moved down over them and the file is cut short. A single symbol still has to fit the
+ * budget, pinned tables may push past it for as long as they are pinned.
+ */
+class SymbolPager
+{
+public:
+    ~SymbolPager()
+    {
+        closeFile();
+    }
+    bool setBudget(size_t maxBytes, const string& spillPath)                   //0 turns paging off, false - spill file can't be created
+    {
+        lock_guard<mutex> lock(guard);
+        closeFile();
+        pages.clear();
+        budget = 0;
+        if(maxBytes == 0)
+            return true;
+        fd = open(spillPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if(fd < 0)
+            return false;
+        path = spillPath;
+        budget = maxBytes;
+        return true;
+    }
+    bool enabled() const
+    {
+        return budget > 0;
+    }
+    size_t budgetBytes() const
+    {
+        return budget;
+    }
+    size_t spilledBytes() const                                                 //dead chunks included
+    {
+        return fileEnd;
+    }
+    bool restoreAll(CowVector<SymbolTable>& tables)                             //every spilled table back in memory, budget or not - before it changes
+    {
+        if(!enabled())
+            return true;
+        lock_guard<mutex> lock(guard);
+        pages.resize(tables.size());
+        for(auto id = 0u; id < tables.size(); ++id)
+            if(!pages[id].whole && !pageIn(tables.edit(id), pages[id]))
+                return false;
+        return true;
+    }
+    void reset()                                                                //the tables got replaced wholesale
+    {
+        if(enabled())
+            setBudget(budget, path);
+    }
+    void refresh(CowVector<SymbolTable>& tables)                                //after an ingest - recounts what's in memory and evicts down to the budget
+    {
+        if(!enabled())
+            return;
+        lock_guard<mutex> lock(guard);
+        pages.resize(tables.size());
+        resident = 0;
+        for(auto id = 0u; id < tables.size(); ++id)
+        {
+            pages[id].bytes = tableBytes(tables[id]);
+            resident += pages[id].bytes;
+        }
+        enforce(tables);
+    }
+    bool acquire(CowVector<SymbolTable>& tables, unsigned symbolId)                //whole table in memory & pinned until release - false if it couldn't be read back
+    {
+        if(!enabled())
+            return true;
+        lock_guard<mutex> lock(guard);
+        if(symbolId >= pages.size())
+            pages.resize(tables.size());
+        auto& page = pages[symbolId];
+        if(!page.whole && !pageIn(tables.edit(symbolId), page))
+            return false;
+        page.lastUse = ++clock;
+        ++page.pins;
+        enforce(tables);
+        return true;
+    }
+    bool follows(unsigned symbolId, const SymbolTable& table)                   //the rows in memory come no earlier than the spilled ones
+    {
+        if(!enabled())
+            return true;
+        lock_guard<mutex> lock(guard);
+        if((symbolId >= pages.size()) || pages[symbolId].whole || (table.size() == 0))
+            return true;
+        return table.timestamps.front() >= pages[symbolId].diskMax;
+    }
+    void rewritten(unsigned symbolId)                                           //acquired table got reordered - what's on disk is stale, the whole lot goes out again
+    {
+        lock_guard<mutex> lock(guard);
+        auto& page = pages[symbolId];
+        for(const auto& chunk : page.chunks)
+            deadBytes += chunk.bytes;
+        page.chunks.clear();
+        page.diskRows = 0;
+        page.diskMax = numeric_limits<time_t>::min();
+        if(deadBytes > fileEnd - deadBytes)
+            compact();
+    }
+    void reordered(unsigned symbolId, size_t firstMoved)                        //rows from firstMoved on got sorted in memory - stale on disk if any of them were spilled
+    {
+        if(!enabled())
+            return;
+        {
+            lock_guard<mutex> lock(guard);
+            if((symbolId >= pages.size()) || !pages[symbolId].whole || (firstMoved >= pages[symbolId].diskRows))
+                return;                                                         //a tail sorted on its own - follows() has the say
+        }
+        rewritten(symbolId);
+    }
+    void release(unsigned symbolId)
+    {
+        if(!enabled())
+            return;
+        lock_guard<mutex> lock(guard);
+        --pages[symbolId].pins;
+    }
+private:
+    struct Chunk
+    {
+        uint64_t offset;
+        uint64_t bytes;
+    };
+    struct Page
+    {
+        bool whole{true};                                                       //false - memory holds only the rows after diskRows
+        size_t diskRows{0};
+        time_t diskMax{numeric_limits<time_t>::min()};                         //last timestamp spilled - tables are kept in time order
+        vector<Chunk> chunks;
+        uint64_t lastUse{0};
+        unsigned pins{0};
+        size_t bytes{0};                                                        //of the table in memory
+    };
+
+    static size_t tableBytes(const SymbolTable& table)
+    {
+        auto total = (table.timestamps.capacity() + table.index.blockMin.capacity() + table.index.blockMax.capacity()) * sizeof(time_t);
+        for(const auto& column : table.columns)
+            total += column.values.capacity() * sizeof(double) + column.present.capacity() * sizeof(uint64_t);
+        return total;
+    }
+    static SymbolTable rowsFrom(const SymbolTable& table, size_t first)         //copy of the rows from 'first' on, renumbered from 0
+    {
+        SymbolTable rows{};
+        rows.timestamps.assign(table.timestamps.begin() + first, table.timestamps.end());
+        rows.columns.resize(table.columns.size());
+        for(auto field = 0u; field < table.columns.size(); ++field)
+            for(auto row = first; row < table.columns[field].values.size(); ++row)
+                if(table.columns[field].has(row))
+                    rows.columns[field].set(row - first, table.columns[field].values[row]);
+        return rows;
+    }
+    void enforce(CowVector<SymbolTable>& tables)                                //evicts least recently used first, pinned ones stay
+    {
+        while(resident > budget)
+        {
+            auto victim = pages.size();
+            for(auto id = 0u; id < pages.size(); ++id)
+                if(!pages[id].pins && pages[id].bytes && ((victim == pages.size()) || (pages[id].lastUse < pages[victim].lastUse)))
+                    victim = id;
+            if((victim == pages.size()) || !evict(tables.edit(victim), pages[victim]))
+                return;
+        }
+    }
+    bool evict(SymbolTable& table, Page& page)                                  //rows not on disk yet go out as one more chunk, then the memory is freed
+    {
+        auto first = page.whole ? page.diskRows : 0u;
+        if(first < table.size())
+        {
+            ostringstream chunk;
+            snapshot::Writer writer(chunk);
+            if(first)
+                snapshot::putTable(writer, rowsFrom(table, first));
+            else
+                snapshot::putTable(writer, table);
+            auto bytes = chunk.str();
+            if(!writeAt(bytes.data(), bytes.size(), fileEnd))
+                return false;                                                   //disk full & co. - stays in memory
+            page.chunks.push_back({fileEnd, bytes.size()});
+            page.diskMax = table.timestamps.back();
+            fileEnd += bytes.size();
+        }
+        page.diskRows += table.size() - first;
+        page.whole = false;
+        resident -= page.bytes;
+        page.bytes = 0;
+        table = SymbolTable{};
+        return true;
+    }
+    bool pageIn(SymbolTable& table, Page& page)                                 //chunks in order, then the tail that stayed in memory
+    {
+        SymbolTable whole{};
+        vector<uint64_t> buffer;
+        for(const auto& chunk : page.chunks)
+        {
+            buffer.resize((chunk.bytes + 7u) / 8u);
+            if(!readAt(reinterpret_cast<char*>(buffer.data()), chunk.bytes, chunk.offset))
+                return false;
+            SymbolTable part{};
+            snapshot::Reader reader(reinterpret_cast<const char*>(buffer.data()), chunk.bytes);
+            if(!snapshot::getTable(reader, ~uint64_t{0}, part))
+                return false;
+            whole.append(part);
+        }
+        whole.append(table);
+        whole.index.update(whole.timestamps);
+        table = move(whole);
+        resident -= page.bytes;
+        page.bytes = tableBytes(table);
+        resident += page.bytes;
+        page.whole = true;
+        return true;
+    }
+    void compact()                                                              //live chunks moved down in file order, over the dead ones
+    {
+        vector<Chunk*> live;
+        for(auto& page : pages)
+            for(auto& chunk : page.chunks)
+                live.push_back(&chunk);
+        sort(live.begin(), live.end(), [](const Chunk* a, const Chunk* b){ return a->offset < b->offset; });
+        uint64_t end{0};
+        vector<char> buffer;
+        for(auto chunk : live)                                                  //never moved up - each write lands within what's allocated already
+        {
+            if(chunk->offset != end)
+            {
+                buffer.resize(chunk->bytes);
+                if(!readAt(buffer.data(), chunk->bytes, chunk->offset) || !writeAt(buffer.data(), chunk->bytes, end))
+                    return;                                                     //the chunks moved so far point at their new place, the rest stays
+                chunk->offset = end;
+            }
+            end += chunk->bytes;
+        }
+        if(ftruncate(fd, static_cast<off_t>(end)) == 0)
+        {
+            fileEnd = end;
+            deadBytes = 0;
+        }
+    }
+    bool readAt(char* data, size_t bytes, uint64_t offset) const
+    {
+        for(size_t done = 0; done < bytes; )
+        {
+            auto got = pread(fd, data + done, bytes - done, static_cast<off_t>(offset + done));
+            if(got <= 0)
+                return false;
+            done += static_cast<size_t>(got);
+        }
+        return true;
+    }
+    bool writeAt(const char* data, size_t bytes, uint64_t offset)
+    {
+        for(size_t done = 0; done < bytes; )
+        {
+            auto written = pwrite(fd, data + done, bytes - done, static_cast<off_t>(offset + done));
+            if(written <= 0)
+                return false;
+            done += static_cast<size_t>(written);
+        }
+        return true;
+    }
+    void closeFile()
+    {
+        if(fd < 0)
+            return;
+        close(fd);
+        unlink(path.c_str());
+        fd = -1;
+        fileEnd = 0;
+        deadBytes = 0;
+        resident = 0;
+    }
+
+    int fd{-1};
+    string path;
+    uint64_t fileEnd{0};
+    uint64_t deadBytes{0};                                                      //of chunks no page points at any more
+    size_t budget{0};
+    size_t resident{0};
+    uint64_t clock{0};
+    vector<Page> pages;                                                         //per symbol id
+    mutex guard;
+};
+
+class TablePin                                                                  //keeps one symbol's table whole & in memory while a query reads it
+{
+public:
+    TablePin(SymbolPager& target, CowVector<SymbolTable>& tables, unsigned id) : pager(target), symbolId(id), ok(pager.acquire(tables, id)){};
+    ~TablePin()
+    {
+        if(ok)
+            pager.release(symbolId);
+    }
+    explicit operator bool() const
+    {
+        return ok;
+    }
+private:
+    SymbolPager& pager;
+    unsigned symbolId;
+    bool ok;
+};
@@ -1,3 +1,4 @@
+#pragma once
 #include <string>
 #include <iostream>
 #include <time.h>
@@ -10,26 +11,162 @@
 #include <fstream>
 #include <cmath>
 #include <utility>
+#include <cstring>
+#include <sstream>
+#include "mappedfile.hpp"
+#include "symboltable.hpp"
+#include "threads.hpp"
+#include "kernels.hpp"
+#include "format.hpp"
+#include "numparse.hpp"
+#include "stats.hpp"
+#include "prefixsums.hpp"
+#include "snapshot.hpp"
+#include "compressed.hpp"
+#include "catalog.hpp"
+#include "aggregate.hpp"
+#include "rollup.hpp"
+#include "paging.hpp"
 
 using namespace std;
-using FieldToIdxMap = unordered_map<string, unsigned>;
-using SymbolDict = unordered_set<string>;
-using Range = pair<unsigned, unsigned>;
 
 class IParser //interface to parsers that can be swapped polimorphicaly on demand
 {
 public:
+   virtual ~IParser() = default;
    virtual bool openTickFile(string) = 0;
-   virtual void print(time_t, time_t, string) = 0;
-   virtual void product(time_t, time_t, string, string, string) = 0;
+   virtual void print(time_t, time_t, string, ostream& out = cout) = 0;        //queries only read the tables - safe to run concurrently, each into its own stream
+   virtual void product(time_t, time_t, string, string, string, ostream& out = cout) = 0;
 };
 
-struct SymbolTable
+struct StrRef                                                                   //non-owning token pointing into the input buffer - poor man's string_view as we're stuck with c++14
 {
-    vector<time_t> timestamps;
-    vector<vector<double>> values;
+    const char* ptr;
+    size_t len;
+    bool empty() const { return len == 0; }
 };
 
+struct NoSchema                                                                 //every line takes the generic path - field names looked up one by one
+{
+    explicit NoSchema(Interner&){};
+    bool parse(StrRef) { return false; }
+    void store(SymbolTable&, size_t) {}
+};
+
+template<typename Schema>
+class BasicTickReader                                                           //tokenizes tick lines straight into the TickData it was given, see schema.hpp for Schema
+{
+public:
+    explicit BasicTickReader(TickData& target) : tick(target), schema(target.fields){};
+    void readLines(istream& in)                                                 //stream fallback, lines still get tokenized in place, only the line buffer is reused
+    {
+        string line;
+        for(;;)
+        {
+            PhaseTimer timer(sampleNext());
+            if(!getline(in, line, '\n'))
+                break;
+            counters.bytes += line.size() + 1;
+            timer.lap(Phase::read);
+            consumeLine(StrRef{line.data(), line.size()}, timer);
+        }
+        extrapolate();
+    }
+    void readBuffer(const char* beg, const char* end)                           //mapped input, no copies of the input are made at all
+    {
+        counters.bytes += static_cast<size_t>(end - beg);
+        while(beg < end)
+        {
+            PhaseTimer timer(sampleNext());
+            auto eol = static_cast<const char*>(memchr(beg, '\n', end - beg));
+            if(eol == nullptr)                                                  //last line without trailing newline
+                eol = end;
+            consumeLine(StrRef{beg, static_cast<size_t>(eol - beg)}, timer);
+            beg = eol + 1;
+        }
+        extrapolate();
+    }
+    const IngestCounters& ingested() const
+    {
+        return counters;
+    }
+private:
+    uint64_t* sampleNext()                                                      //every SAMPLE_EVERY-th line gets its phases timed, see stats.hpp
+    {
+        if(!STATS_ENABLED || (++lines % Stats::SAMPLE_EVERY))
+            return nullptr;
+        ++sampledLines;
+        return sampledNs;
+    }
+    void extrapolate()
+    {
+        for(auto phase = 0u; phase < PHASE_COUNT; ++phase)
+            counters.phaseNs[phase] = sampledLines ? sampledNs[phase] * lines / sampledLines : 0u;
+    }
+    void consumeLine(StrRef line, PhaseTimer& timer)
+    {
+        if(!line.empty() && line.ptr[line.len-1] == '\r')
+            --line.len;
+        if(line.empty())
+            return;
+        ++counters.rows;
+        StrRef timeToken = consumeString(line);
+        StrRef symbol = consumeString(line);
+        timer.lap(Phase::tokenize);
+        time_t timeStamp = numparse::parseTime(timeToken.ptr, timeToken.len);
+        timer.lap(Phase::numberParse);
+        auto symbolId = tick.symbols.intern(symbol.ptr, symbol.len);            //one hash of the raw token, whether it's known or not
+        if(symbolId == tick.tables.size())                                      //symbol not yet encountered case
+            tick.tables.emplace_back();
+        auto& table = tick.tables.edit(symbolId);                               //the copy of a table another version shares happens here, once
+        table.timestamps.push_back(timeStamp);
+        timer.lap(Phase::tableInsert);
+        consumeFields(line, table, timer);
+    }
+    StrRef consumeString(StrRef& line)
+    {
+        auto firstComa = static_cast<const char*>(memchr(line.ptr, ',', line.len));
+        if(firstComa == nullptr)
+        {
+            StrRef str = line;
+            line = StrRef{line.ptr + line.len, 0};
+            return str;
+        }
+        StrRef str{line.ptr, static_cast<size_t>(firstComa - line.ptr)};
+        line = StrRef{firstComa + 1, line.len - str.len - 1};
+        return str;
+    }
+    void consumeFields(StrRef& line, SymbolTable& table, PhaseTimer& timer)     //values go straight into their columns of the last row
+    {
+        auto row = table.size() - 1;
+        if(schema.parse(line))                                                  //a line the schema knows - slots fixed at compile time
+        {
+            timer.lap(Phase::numberParse);
+            schema.store(table, row);
+            timer.lap(Phase::tableInsert);
+            return;
+        }
+        while(!line.empty())
+        {
+            StrRef fieldName = consumeString(line);
+            StrRef valueToken = consumeString(line);
+            timer.lap(Phase::tokenize);
+            double fieldValue = numparse::parseDecimal(valueToken.ptr, valueToken.len);
+            timer.lap(Phase::numberParse);
+            table.set(row, tick.fields.intern(fieldName.ptr, fieldName.len), fieldValue);
+            timer.lap(Phase::tableInsert);
+        }
+    }
+
+    TickData& tick;
+    Schema schema;
+    IngestCounters counters{};
+    uint64_t lines{0};
+    uint64_t sampledLines{0};
+    uint64_t sampledNs[PHASE_COUNT]{};
+};
+using TickReader = BasicTickReader<NoSchema>;
+
 /* Desc: the underlying data structure for the problem at hand can be considered to be a tensor of rank 3 with dimensions [K x L x M]
  * , where K is the number of unique symbols, L the number of timestamps (not neccesarily unique) and M the number of fields. It
  * is also equivalent to a problem of K independent L by M  matirces - this approach is also what is implemented in the code below
@@ -41,9 +178,9 @@ struct SymbolTable
  * https://www.youtube.com/watch?v=WDIkqP4JbkE
  * Due to the above mentioned facts, it is most advantageous to work on vectors (chosen here) or arrays.
  * The two required optimization options entail their specific considerations:
- * -Oprint) the vector of vectors structure used should already be pretty friendly. The assembly of print buffers could be parallelized,
- *          though.
- * -Oproduct) efficient use of cache requires matrix transposition to [M x N] form but also product calculations are easily parallelized
+ * -Oprint) rows are gathered across the field columns, M is small so that stays cache friendly. The assembly of print buffers could be
+ *          parallelized, though.
+ * -Oproduct) efficient use of cache requires matrix transposition to [M x N] form (done - see SymbolTable) but also product calculations are easily parallelized
  *            into multiple threads (nice linear scaling) as long as thread local data is used for partial product calculation. SSE2
  *            instructions accessed via compiler intrinsics could also help boost performance of doubles - however, availabiliy of those
  *            is hardware specific.
@@ -51,184 +188,1027 @@ struct SymbolTable
 class Parser : public IParser
 {
 public:
-    Parser() : fieldToIdx(100u), symbolDict(100u){}; //the size is most likely a bit of a stretch
+    void setIngestThreads(unsigned threads)                                     //0 lets the hardware & the file size decide
+    {
+        ingestThreads = threads;
+    }
+    bool followTickFile(string fName)                                           //parses only the complete lines appended since the file was last read
+    {
+        auto offsetIt = fileOffsets.insert({fName, 0u}).first;                  //never seen - follow it from the top
+        auto mapStart = nowNs();
+        MappedFile mapped(fName, offsetIt->second);
+        addReadTime(nowNs() - mapStart);
+        if(!mapped)
+        {
+            fileOffsets.erase(offsetIt);
+            return false;
+        }
+        if(mapped.fileSize() < offsetIt->second)                                //truncated or rotated - start over
+        {
+            offsetIt->second = 0;
+            return followTickFile(fName);
+        }
+        auto lastEol = static_cast<const char*>(memrchr(mapped.data(), '\n', mapped.size()));  //a line still being written is left for next time
+        if(lastEol)
+        {
+            ingest(mapped.data(), lastEol + 1);
+            offsetIt->second += static_cast<size_t>(lastEol + 1 - mapped.data());
+        }
+        return true;
+    }
+    bool saveSnapshot(const string& path)                                       //binary columnar dump of everything loaded so far, see snapshot.hpp
+    {
+        if(pager.enabled())                                                     //a symbol at a time, paged in & out as it goes
+            return writeSnapshot(tick.fields, tick.symbols, tick.tables.size(), [&](unsigned symbolId, const function<void(const SymbolTable&)>& put){
+                TablePin pin(pager, tick.tables, symbolId);
+                if(!pin)                                                        //no snapshot rather than one with a symbol missing
+                {
+                    reportPageInFailure(symbolId);
+                    return false;
+                }
+                put(tick.tables[symbolId]);
+                return true;
+            }, path);
+        if(!compressed)
+            return writeSnapshot(tick, path);
+        TickData unpacked{};                                                    //snapshots stay in the raw layout
+        unpacked.fields = tick.fields;
+        unpacked.symbols = tick.symbols;
+        unpacked.tables.resize(packed.size());
+        for(auto id = 0u; id < packed.size(); ++id)
+            packed[id].unpack(unpacked.tables.edit(id));
+        return writeSnapshot(unpacked, path);
+    }
+    bool loadSnapshot(const string& path)                                       //replaces whatever was loaded, a bad snapshot leaves it alone
+    {
+        if(readSnapshot(tick, path) != SnapshotStatus::ok)
+            return false;
+        prefixSums.clear();
+        fileOffsets.clear();
+        packed.clear();
+        rollups.clear();
+        pager.reset();
+        segments.clear();                                                       //their ids belong to the dictionaries just replaced
+        updateIndices();
+        return true;
+    }
+    void setCompressedStorage(bool on)                                          //delta/XOR encoded blocks instead of raw columns, see compressed.hpp
+    {
+        if((on == compressed) || pager.enabled())                               //paging works on raw tables only
+            return;
+        compressed = on;
+        prefixSums.clear();                                                     //the cache works on raw columns only
+        if(compressed)
+        {
+            rollups.clear();                                                    //they index raw rows
+            packTables();
+            return;
+        }
+        for(auto id = 0u; id < packed.size(); ++id)
+            packed[id].unpack(tick.tables.edit(id));
+        packed.clear();
+        updateRollups();
+    }
+    bool setRollups(bool on, const vector<pair<string, string>>& pairs = {})    //minute/hour/day buckets of every field plus the products of 'pairs', see rollup.hpp
+    {                                                                           //false - refused, nothing changed
+        if(pager.enabled())                                                     //rollups index raw rows, paged tables keep only a tail of them
+            return false;
+        vector<pair<unsigned, unsigned>> ids;
+        for(const auto& names : pairs)                                          //a field not loaded yet has no id - interning it would leave a phantom field
+        {
+            ids.push_back({tick.fields.find(names.first), tick.fields.find(names.second)});
+            if((ids.back().first == Interner::NONE) || (ids.back().second == Interner::NONE))
+                return false;
+        }
+        rollupsOn = on;
+        rollups.clear();
+        rollupPairs = move(ids);
+        updateRollups();
+        return true;
+    }
+    size_t storageBytes() const                                                 //heap bytes held by the rows, raw or packed
+    {
+        size_t total{0};
+        for(auto id = 0u; id < tick.tables.size(); ++id)
+        {
+            const auto& table = tick.tables[id];
+            total += (table.timestamps.capacity() + table.index.blockMin.capacity() + table.index.blockMax.capacity()) * sizeof(time_t);
+            for(const auto& column : table.columns)
+                total += column.values.capacity() * sizeof(double) + column.present.capacity() * sizeof(uint64_t);
+        }
+        for(auto id = 0u; id < packed.size(); ++id)
+            total += packed[id].bytes();
+        for(auto id = 0u; id < rollups.size(); ++id)
+            total += rollups[id].bytes();
+        return total;
+    }
+    void setPrefixSumBudget(size_t maxBytes)                                    //opt-in cache of per (symbol, field1, field2) running products, 0 turns it off
+    {
+        prefixSums.setBudget(maxBytes);
+        if(maxBytes == 0)
+            prefixSums.clear();
+    }
+    bool setMemoryBudget(size_t maxBytes, const string& spillPath)             //out-of-core raw tables, see paging.hpp - 0 turns it off, false if refused
+    {
+        if(compressed || rollupsOn)
+            return false;
+        if(!pager.restoreAll(tick.tables) || !pager.setBudget(maxBytes, spillPath))
+            return false;
+        pager.refresh(tick.tables);
+        return true;
+    }
+    void printStats(ostream& out = cout) const                                  //ingest counters & phases, query latency histograms - see stats.hpp
+    {
+        stats.dump(out);
+    }
+    void resetStats()
+    {
+        stats.reset();
+    }
+    void copyDataFrom(const Parser& other)                                      //everything loaded plus the settings - the base of a new server version, per symbol data stays shared until an ingest touches it
+    {
+        tick = other.tick;
+        compressed = other.compressed;
+        packed = other.packed;
+        segments = other.segments;
+        fileOffsets = other.fileOffsets;
+        rollups = other.rollups;
+        rollupPairs = other.rollupPairs;
+        rollupsOn = other.rollupsOn;
+        ingestThreads = other.ingestThreads;
+        queryThreads = other.queryThreads;
+        prefixSums.clear();                                                     //the cache refills on demand, only its budget carries over
+        prefixSums.setBudget(other.prefixSums.budgetBytes());
+        stats.copyFrom(other.stats);                                            //latency histograms included
+    }
     bool openTickFile(string fName) override
     {
-        data = ifstream(fName, std::ios::in);
-        readInData();
+        auto mapStart = nowNs();
+        MappedFile mapped(fName);
+        addReadTime(nowNs() - mapStart);
+        if(mapped)                                                              //regular file - tokenize the mapping in place
+        {
+            ingest(mapped.data(), mapped.data() + mapped.size());
+            fileOffsets[fName] = mapped.size();
+            return true;
+        }
+        data = ifstream(fName, std::ios::in);                                   //pipes, devices & co. - good old line by line
+        if(pager.enabled() && data)
+        {
+            ingestStream(data);
+            data.close();
+            return true;
+        }
+        stats.addIngest(readStream(tick, data));
+        updateIndices();
         auto wasOpened = data.is_open();
         data.close();
         return wasOpened;
     }
-    void print(time_t startTime, time_t endTime, string symbol) override
+    size_t openTickFiles(const string& pattern)                                 //one segment per matching file, loaded in parallel - returns how many made it
     {
-        if(symbolDict.find(symbol) != symbolDict.end())
+        auto files = expandGlob(pattern);
+        vector<TickData> parts(files.size());
+        vector<IngestCounters> counters(files.size());
+        vector<char> loaded(files.size(), 0);
+        auto workers = min<unsigned>(defaultThreadCount(), static_cast<unsigned>(files.size()));
+        parallelFor(workers, [&](unsigned w){                                   //a file per worker at a time, each into its own TickData
+            for(auto i = w; i < files.size(); i += workers)
+            {
+                MappedFile mapped(files[i]);
+                if(!mapped)
+                    continue;
+                counters[i] = readChunk(parts[i], mapped.data(), mapped.data() + mapped.size());
+                auto sortStart = nowNs();
+                for(auto id = 0u; id < parts[i].tables.size(); ++id)            //a segment's symbols are in time order before it gets published
+                    if(auto moved = parts[i].tables.edit(id).sortByTime(0))
+                    {
+                        counters[i].sortedRows += moved;
+                        ++counters[i].sortedSymbols;
+                    }
+                counters[i].phaseNs[static_cast<unsigned>(Phase::sort)] += nowNs() - sortStart;
+                loaded[i] = 1;
+            }
+        });
+        size_t count{0};
+        for(auto i = 0u; i < files.size(); ++i)                                 //ids get handed out in file order - deterministic
         {
-            const auto& times = symbolTables[symbol].timestamps;
-            auto rangeBeg = (startTime < times[0] ? times.begin() : find_if(times.begin(), times.end(), [&](auto& a){return a >= startTime;}) ) ;
-            auto rangeEnd = (endTime > times.back() ? times.end() : find_if(rangeBeg, times.end(), [&](auto& a){return a+1 > endTime;}) ) ;
-
-            if((rangeBeg != times.end()) && (rangeBeg < rangeEnd))
+            if(!loaded[i])
+                continue;
+            unloadTickFile(files[i]);                                           //loading a day again replaces it
+            segments.push_back(make_shared<const Segment>(makeSegment(files[i], parts[i])));
+            stats.addIngest(counters[i]);
+            ++count;
+        }
+        sort(segments.begin(), segments.end(), [](const shared_ptr<const Segment>& a, const shared_ptr<const Segment>& b){
+            return (a->minTime < b->minTime) || ((a->minTime == b->minTime) && (a->file < b->file));
+        });
+        updateIndices();
+        return count;
+    }
+    bool unloadTickFile(const string& fName)                                    //drops one segment, the rest stays as it is
+    {
+        auto segmentIt = find_if(segments.begin(), segments.end(), [&](const shared_ptr<const Segment>& segment){ return segment->file == fName; });
+        if(segmentIt == segments.end())
+            return false;
+        segments.erase(segmentIt);
+        return true;
+    }
+    void print(time_t startTime, time_t endTime, string symbol, ostream& out = cout) override    //symbol may also be a set, see selectSymbols
+    {
+        ScopedLatency latency(stats.print);
+        if(!isSymbolSet(symbol))
+        {
+            auto symbolId = tick.symbols.find(symbol);
+            if(symbolId != Interner::NONE)
+                printSymbol(out, symbolId, startTime, endTime);
+            return;
+        }
+        fanOut(selectSymbols(symbol), [&](unsigned symbolId){
+            ostringstream rows;
+            printSymbol(rows, symbolId, startTime, endTime);
+            return rows.str();
+        }, [&](unsigned symbolId, const string& rows){
+            if(!rows.empty())                                                   //"<symbol>:" heads the rows of every symbol that has some
+                out << tick.symbols.name(symbolId) << ":\n" << rows;
+        });
+    }
+    void product(time_t startTime, time_t endTime, string symbol, string field1, string field2, ostream& out = cout) override
+    {
+        product(startTime, endTime, symbol, field1, field2, false, out);
+    }
+    void product(time_t startTime, time_t endTime, const string& symbol, const string& field1, const string& field2, bool grandTotal,
+                 ostream& out)                                                  //a set prints "<symbol> <product>" per symbol with rows, then "total <sum>" if asked
+    {
+        ScopedLatency latency(stats.product);
+        auto field1Id = tick.fields.find(field1);                               //names are resolved once, the scans only see ids
+        auto field2Id = tick.fields.find(field2);
+        if(!isSymbolSet(symbol))
+        {
+            auto symbolId = tick.symbols.find(symbol);
+            double product{0};
+            if((symbolId != Interner::NONE) && symbolProduct(symbolId, startTime, endTime, field1Id, field2Id, product))
+                out << std::fixed << std::setprecision(3) << product << "\n";
+            return;
+        }
+        auto anyRows = false;
+        double total{0};
+        fanOut(selectSymbols(symbol), [&](unsigned symbolId){
+            pair<bool, double> result{false, 0.0};
+            result.first = symbolProduct(symbolId, startTime, endTime, field1Id, field2Id, result.second);
+            return result;
+        }, [&](unsigned symbolId, const pair<bool, double>& result){
+            if(!result.first)
+                return;
+            anyRows = true;
+            total += result.second;                                             //added in output order - the same set always totals up the same way
+            out << tick.symbols.name(symbolId) << " " << std::fixed << std::setprecision(3) << result.second << "\n";
+        });
+        if(grandTotal && anyRows)
+            out << "total " << std::fixed << std::setprecision(3) << total << "\n";
+    }
+    void setQueryThreads(unsigned threads)                                      //workers symbol sets fan out on, 0 - one per hardware thread
+    {
+        lock_guard<mutex> lock(queryPoolGuard);
+        queryThreads = threads;
+        queryPool.reset();
+    }
+    bool aggregate(time_t startTime, time_t endTime, const string& symbol, const string& func, const vector<string>& exprs,
+                   ostream& out = cout)                                         //false - unknown function or malformed expression
+    {
+        ScopedLatency latency(stats.aggregate);
+        AggPlan plan{};
+        if(!AggPlan::compile(func, exprs, tick.fields, plan))
+            return false;
+        auto symbolId = tick.symbols.find(symbol);
+        if(symbolId == Interner::NONE)
+            return true;
+        auto anyRows = false;
+        Moments moments{};
+        if(compressed)
+        {
+            auto range = packed[symbolId].findRange(startTime, endTime);
+            if(range.first < range.second)
             {
-                const auto& vals = symbolTables[symbol].values;
-                for(auto it = vals.begin()+distance(times.begin(), rangeBeg);
-                         it != vals.begin()+distance(times.begin(), rangeEnd);
-                         ++it)
+                anyRows = true;
+                auto fields = plan.fieldIds();
+                SymbolTable block{};
+                for(auto b = range.first / PackedTable::BLOCK; b * PackedTable::BLOCK < range.second; ++b)
                 {
-                    printValueVector(*it);
+                    packed[symbolId].decodeBlock(b, block, &fields);
+                    auto base = b * PackedTable::BLOCK;
+                    plan.run(moments, block, Range{static_cast<unsigned>(max<size_t>(range.first, base) - base),
+                                                   static_cast<unsigned>(min<size_t>(range.second, base + block.size()) - base)});
                 }
             }
         }
+        else
+        {
+            TablePin pin(pager, tick.tables, symbolId);
+            if(!pin)
+                reportPageInFailure(symbolId);
+            const auto& table = tick.tables[symbolId];
+            auto range = pin ? findRange(table, startTime, endTime) : Range{0, 0};
+            auto rollup = findRollup(symbolId);
+            auto field = plan.rollupField();
+            if((range.first < range.second) && rollup && (field != Interner::NONE))
+            {
+                anyRows = true;
+                moments.shifted = true;                                         //bucket sums are plain ones - no shift
+                rollup->cover(range, [&](unsigned level, size_t b){
+                    const auto& bucket = rollup->fieldBucket(level, b, field);
+                    moments.count += bucket.count;
+                    moments.sumX += bucket.sum;
+                    moments.minX = min(moments.minX, bucket.min);
+                    moments.maxX = max(moments.maxX, bucket.max);
+                }, [&](Range edge){ plan.run(moments, table, edge); });
+            }
+            else if(range.first < range.second)
+            {
+                anyRows = true;
+                plan.run(moments, table, range);
+            }
+        }
+        for(const auto& segment : segments)
+        {
+            auto table = segment->table(symbolId, startTime, endTime);
+            auto range = table ? findRange(*table, startTime, endTime) : Range{0, 0};
+            if(range.first < range.second)
+            {
+                anyRows = true;
+                plan.run(moments, *table, range);
+            }
+        }
+        if(anyRows)
+            plan.print(out, moments);
+        return true;
     }
-    void product(time_t startTime, time_t endTime, string symbol, string field1, string field2) override
+protected:
+    const SymbolTable* findTable(const string& symbol) const
     {
-        if(symbolDict.find(symbol) != symbolDict.end())
-        {
-            const auto& times = symbolTables[symbol].timestamps;
-            auto rangeBeg = (startTime < times[0] ? times.begin() : find_if(times.begin(), times.end(), [&](auto& a){return a >= startTime;}) ) ;
-            auto rangeEnd = (endTime > times.back() ? times.end() : find_if(rangeBeg, times.end(), [&](auto& a){return a+1 > endTime;}) ) ;
+        auto symbolId = tick.symbols.find(symbol);
+        return symbolId != Interner::NONE ? &tick.tables[symbolId] : nullptr;
+    }
+    static Range findRange(const SymbolTable& table, time_t startTime, time_t endTime)  //[first row >= start, first row >= end after it)
+    {
+        const auto& times = table.timestamps;
+        if(times.empty())
+            return Range{0, 0};
+        auto rangeBeg = (startTime < times[0] ? 0u : table.index.firstNotBefore(times, startTime, 0u));
+        auto rangeEnd = (endTime > times.back() ? times.size() : table.index.firstNotBefore(times, endTime, rangeBeg));
+        if((rangeBeg == times.size()) || (rangeBeg >= rangeEnd))
+            return Range{0, 0};
+        return Range{static_cast<unsigned>(rangeBeg), static_cast<unsigned>(rangeEnd)};
+    }
 
-            double product{0};
-            if((rangeBeg != times.end()) && (rangeBeg < rangeEnd))
+    TickData tick{};
+    Stats stats{};
+    bool compressed{false};
+    CowVector<PackedTable> packed;                                              //per symbol id, compressed mode only - tick.tables then just stage new rows
+    vector<shared_ptr<const Segment>> segments;                                 //tickfiles - one per file, sorted by their first timestamp, immutable once made
+private:
+    static constexpr size_t MIN_INGEST_CHUNK = 4u << 20;                        //below that a thread costs more than it brings
+    static constexpr size_t MIN_BUDGET_SLICE = 64u << 10;
+    void ingest(const char* beg, const char* end)                               //under a memory budget a slice at a time, evictions after each
+    {
+        auto slice = pager.enabled() ? max(pager.budgetBytes() / 4u, size_t{MIN_BUDGET_SLICE}) : static_cast<size_t>(end - beg);
+        do
+        {
+            auto sliceEnd = end;
+            if(static_cast<size_t>(end - beg) > slice)
+            {
+                auto eol = static_cast<const char*>(memchr(beg + slice, '\n', static_cast<size_t>(end - beg) - slice));
+                sliceEnd = eol ? eol + 1 : end;
+            }
+            readInData(beg, sliceEnd);
+            updateIndices();
+            beg = sliceEnd;
+        } while(beg < end);
+    }
+    void ingestStream(istream& in)                                              //stream input under a memory budget - blocks of complete lines
+    {
+        vector<char> block(max(pager.budgetBytes() / 4u, size_t{MIN_BUDGET_SLICE}));
+        string lines;
+        while(in.read(block.data(), static_cast<streamsize>(block.size())) || in.gcount())
+        {
+            lines.append(block.data(), static_cast<size_t>(in.gcount()));
+            auto lastEol = lines.rfind('\n');
+            if(lastEol == string::npos)
+                continue;
+            ingest(lines.data(), lines.data() + lastEol + 1);
+            lines.erase(0, lastEol + 1);
+        }
+        ingest(lines.data(), lines.data() + lines.size());                      //last line without trailing newline
+    }
+    void readInData(const char* beg, const char* end)                           //splits the mapping on line boundaries, one chunk per worker
+    {
+        auto size = static_cast<size_t>(end - beg);
+        auto chunks = ingestThreads ? ingestThreads
+                                    : static_cast<unsigned>(min<size_t>(defaultThreadCount(), max<size_t>(1u, size / MIN_INGEST_CHUNK)));
+        if(chunks <= 1)
+        {
+            stats.addIngest(readChunk(tick, beg, end));
+            return;
+        }
+        vector<const char*> bounds(chunks + 1, end);
+        bounds[0] = beg;
+        for(auto i = 1u; i < chunks; ++i)
+        {
+            auto from = max(beg + size * i / chunks, bounds[i-1]);
+            auto eol = static_cast<const char*>(memchr(from, '\n', end - from));
+            bounds[i] = eol ? eol + 1 : end;
+        }
+        vector<TickData> parts(chunks - 1);                                     //the first chunk goes straight into the main tables, the rest gets merged behind it
+        vector<IngestCounters> counters(chunks);
+        parallelFor(chunks, [&](unsigned i){
+            counters[i] = readChunk(i == 0 ? tick : parts[i-1], bounds[i], bounds[i+1]);
+        });
+        for(const auto& counter : counters)
+            stats.addIngest(counter);
+        mergeParts(parts);
+    }
+    void mergeParts(vector<TickData>& parts)                                    //appends worker results in file order, field & symbol ids get translated to the global ones
+    {
+        vector<vector<unsigned>> remaps(parts.size());
+        vector<vector<pair<unsigned, SymbolTable*>>> pieces;                    //per global symbol - the (part, table) pieces that go behind it
+        vector<unsigned> touched;
+        for(auto p = 0u; p < parts.size(); ++p)                                 //walking the parts in order keeps the fields in order of first appearance
+        {
+            for(const auto& name : parts[p].fields.allNames())
+                remaps[p].push_back(tick.fields.intern(name));
+            for(auto local = 0u; local < parts[p].tables.size(); ++local)
+            {
+                auto global = tick.symbols.intern(parts[p].symbols.name(local));
+                if(global >= pieces.size())
+                    pieces.resize(global + 1);
+                if(pieces[global].empty())
+                    touched.push_back(global);
+                pieces[global].push_back({p, &parts[p].tables.edit(local)});
+            }
+        }
+        tick.tables.resize(tick.symbols.size());                                //no more reallocation from here on
+        auto workers = min<unsigned>(static_cast<unsigned>(parts.size()) + 1, static_cast<unsigned>(touched.size()));
+        parallelFor(workers, [&](unsigned w){                                   //symbols are independent of each other, so are their merges
+            vector<size_t> lengths;
+            for(auto t = w; t < touched.size(); t += workers)
             {
-                const auto& vals = symbolTables[symbol].values;
-                for(auto it = vals.begin()+distance(times.begin(), rangeBeg);   //TODO: split outer vector traversal into threads
-                         it != vals.begin()+distance(times.begin(), rangeEnd);
-                         ++it)
+                auto& table = tick.tables.edit(touched[t]);
+                finalLengths(table, pieces[touched[t]], remaps, lengths);
+                for(auto& piece : pieces[touched[t]])
                 {
-                    product += calculateProduct(*it, field1, field2);
+                    appendTable(table, *piece.second, remaps[piece.first], lengths);
                 }
-                cout << std::fixed << std::setprecision(3) << product << "\n";
             }
+        });
+    }
+    static void finalLengths(const SymbolTable& table, const vector<pair<unsigned, SymbolTable*>>& pieces,
+                             const vector<vector<unsigned>>& remaps, vector<size_t>& lengths)   //sizes after the merge - [0] rows, [1 + field] column lengths
+    {
+        auto rows = table.size();
+        lengths.assign(1 + table.columns.size(), 0u);
+        for(auto field = 0u; field < table.columns.size(); ++field)
+            lengths[1 + field] = table.columns[field].values.size();
+        for(const auto& piece : pieces)
+        {
+            const auto& columns = piece.second->columns;
+            for(auto field = 0u; field < columns.size(); ++field)
+            {
+                if(columns[field].values.empty())
+                    continue;
+                auto global = remaps[piece.first][field];
+                if(1 + global >= lengths.size())
+                    lengths.resize(2 + global, 0u);
+                lengths[1 + global] = rows + columns[field].values.size();     //pieces come in row order, the last one decides
+            }
+            rows += piece.second->size();
         }
+        lengths[0] = rows;
     }
-private:
-    double calculateProduct(const vector<double>& vals, const string& field1, const string& field2)
+    static void appendTable(SymbolTable& table, SymbolTable& piece, const vector<unsigned>& remap, const vector<size_t>& lengths)
     {
-        if((fieldToIdx.find(field1) != fieldToIdx.end())                        //this monstrosity checks a couple of things: 1) was the requested field present in the input file at all?
-                && (vals.size() >= fieldToIdx[field1])                          //2) is the current vector of values large enought to contain the values for 'field1' - the vectors grow anytime a new field is encoutered in the source file
-                && (fieldToIdx.find(field2) != fieldToIdx.end())                //3) same as 1) but for field2
-                && (vals.size() >= fieldToIdx[field2])                          //4) same as 2) but for field2 (the ordering of these conditions can have impact on performance but i couldn't be bothered with that)
-                && (!isnan(vals[fieldToIdx[field1]]))                           //5) checks if the 'matrix-element' corresponding to [time,field1] is not NaN
-                && (!isnan(vals[fieldToIdx[field2]])))                          //6) checks if the 'matrix-element' corresponding to [time,field2] is not NaN
+        auto offset = table.size();
+        table.timestamps.reserve(lengths[0]);                                   //grown to the final size once, not doubled a piece at a time
+        table.timestamps.insert(table.timestamps.end(), piece.timestamps.begin(), piece.timestamps.end());
+        for(auto field = 0u; field < piece.columns.size(); ++field)
         {
-            return vals[fieldToIdx[field1]]*vals[fieldToIdx[field2]];           //inner_product() perhaps some day if operation should be generic?
+            auto global = remap[field];
+            if(global >= table.columns.size())
+                table.columns.resize(global + 1);
+            auto& column = table.columns[global];
+            if((offset == 0) && column.values.empty())                          //nothing to shift - just steal the buffers
+            {
+                column = move(piece.columns[field]);
+                continue;
+            }
+            column.reserve(lengths[1 + global]);
+            column.appendAt(offset, piece.columns[field]);
         }
-        return 0.0;
     }
-    void printValueVector(const vector<double>& vals)
+    void updateIndices()                                                        //only rows appended since the last load get looked at
     {
-        string coma="";
-        for(auto i = 0u; i < vals.size(); ++i)
-            if(!isnan(vals[i]))
+        if(compressed)
+            packTables();
+        else
+        {
+            sortTables();
+            updateRollups();
+            pager.refresh(tick.tables);
+        }
+        stats.setSizes(tick.symbols.size(), tick.fields.size());
+    }
+    void sortTables()                                                           //symbols in parallel - rows that came in out of time order get stable sorted before any query sees them
+    {
+        IngestCounters sorting{};
+        mutex sortingGuard;
+        vector<char> reordered(tick.tables.size(), 0);
+        vector<size_t> firstMoved(tick.tables.size(), 0);
+        auto workers = min<unsigned>(defaultThreadCount(), static_cast<unsigned>(tick.tables.size()));
+        parallelFor(workers, [&](unsigned w){
+            IngestCounters local{};
+            auto start = nowNs();
+            for(auto id = w; id < tick.tables.size(); id += workers)
             {
-                cout << coma << fieldNames[i] << ":" << std::fixed << std::setprecision(3) << vals[i];
-                coma = ",";
+                const auto& current = tick.tables[id];
+                if(current.index.sorted && (current.index.rows == current.size()))  //nothing appended - a table another version shares stays shared
+                    continue;
+                auto& table = tick.tables.edit(id);
+                auto inOrder = table.index.sorted ? table.index.rows : 0;       //rows indexed in order stay put, a loader may have indexed unsorted ones
+                table.index.update(table.timestamps);
+                if(table.index.sorted)                                          //the fast path - appended rows came in order
+                    continue;
+                auto moved = table.sortByTime(inOrder);
+                local.sortedRows += moved;
+                ++local.sortedSymbols;
+                reordered[id] = 1;
+                firstMoved[id] = table.size() - moved;
+            }
+            local.phaseNs[static_cast<unsigned>(Phase::sort)] = nowNs() - start;    //the in order check included
+            lock_guard<mutex> lock(sortingGuard);
+            sorting += local;
+        });
+        auto start = nowNs();
+        for(auto id = 0u; id < tick.tables.size(); ++id)                        //spilled symbols whose new rows belong in between the ones on disk
+        {
+            if(reordered[id])
+                pager.reordered(id, firstMoved[id]);                            //a paged in table sorted in place may have moved rows it spilled before
+            if(pager.follows(id, tick.tables[id]))
+                continue;
+            TablePin pin(pager, tick.tables, id);
+            if(!pin)
+            {
+                reportPageInFailure(id);
+                continue;
             }
-        cout << "\n";
+            sorting.sortedRows += tick.tables.edit(id).sortByTime(0);
+            ++sorting.sortedSymbols;
+            reordered[id] = 1;
+            pager.rewritten(id);
+        }
+        if(sorting.sortedSymbols)
+        {
+            prefixSums.clear();                                                 //rows moved under them
+            for(auto id = 0u; id < min(reordered.size(), rollups.size()); ++id)
+                if(reordered[id])
+                    rollups.replace(id, Rollup{});
+        }
+        sorting.phaseNs[static_cast<unsigned>(Phase::sort)] += nowNs() - start;
+        stats.addIngest(sorting);
     }
-    void readInData()                                                           //this method (as well as all the consumations) makes me sad :(. This could probably be a one-liner with spirit
+    void updateRollups()                                                        //symbols in parallel, each only over its appended rows
     {
-        string line;
-        while(getline(data, line, '\n'))
+        if(!rollupsOn || compressed)
+            return;
+        rollups.resize(tick.tables.size());
+        auto workers = min<unsigned>(defaultThreadCount(), static_cast<unsigned>(tick.tables.size()));
+        parallelFor(workers, [&](unsigned w){
+            for(auto id = w; id < tick.tables.size(); id += workers)
+                if(rollups[id].rowsCovered() != tick.tables[id].size())        //untouched symbols keep sharing theirs
+                    rollups.edit(id).update(tick.tables[id], rollupPairs);
+        });
+    }
+    const Rollup* findRollup(unsigned symbolId) const                           //null if raw rows are all there is
+    {
+        if(!rollupsOn || compressed || (symbolId >= rollups.size()) || !rollups[symbolId].valid())
+            return nullptr;
+        return &rollups[symbolId];
+    }
+    void packTables()                                                           //staged raw rows move into the packed blocks, symbols in parallel
+    {
+        IngestCounters sorting{};
+        mutex sortingGuard;
+        packed.resize(tick.tables.size());
+        auto workers = min<unsigned>(defaultThreadCount(), static_cast<unsigned>(tick.tables.size()));
+        parallelFor(workers, [&](unsigned w){
+            IngestCounters local{};
+            for(auto id = w; id < tick.tables.size(); id += workers)
+            {
+                if(tick.tables[id].size() == 0)                                 //nothing staged - the packed table stays shared
+                    continue;
+                auto start = nowNs();
+                auto& staged = tick.tables.edit(id);
+                auto moved = staged.sortByTime(0);
+                auto& table = packed.edit(id);
+                if(table.size() && staged.size() && (staged.timestamps.front() < table.lastTime()))    //goes in between packed rows - repacked whole
+                {
+                    SymbolTable whole{};
+                    table.unpack(whole);
+                    auto inOrder = whole.size();
+                    whole.append(staged);
+                    moved += whole.sortByTime(inOrder);
+                    table = PackedTable{};
+                    staged = move(whole);
+                }
+                if(moved)
+                {
+                    local.sortedRows += moved;
+                    ++local.sortedSymbols;
+                }
+                local.phaseNs[static_cast<unsigned>(Phase::sort)] += nowNs() - start;
+                table.append(staged);
+            }
+            lock_guard<mutex> lock(sortingGuard);
+            sorting += local;
+        });
+        stats.addIngest(sorting);
+    }
+    void printPacked(ostream& out, const PackedTable& table, Range range) const    //one touched block decoded at a time
+    {
+        SymbolTable block{};
+        for(auto b = range.first / PackedTable::BLOCK; b * PackedTable::BLOCK < range.second; ++b)
         {
-            time_t timeStamp = consumeTime(line);
-            string symbol = consumeString(line);
-            if(symbolDict.find(symbol) == symbolDict.end())                     //symbol not yet encountered case
+            table.decodeBlock(b, block);
+            auto base = b * PackedTable::BLOCK;
+            printRange(out, block, Range{static_cast<unsigned>(max<size_t>(range.first, base) - base),
+                                         static_cast<unsigned>(min<size_t>(range.second, base + block.size()) - base)});
+        }
+    }
+    double packedProduct(const PackedTable& table, Range range, unsigned field1, unsigned field2) const
+    {
+        if((field1 == Interner::NONE) || (field2 == Interner::NONE))
+            return 0.0;
+        vector<unsigned> fields{field1, field2};
+        SymbolTable block{};
+        double product{0};
+        for(auto b = range.first / PackedTable::BLOCK; b * PackedTable::BLOCK < range.second; ++b)
+        {
+            table.decodeBlock(b, block, &fields);                               //only the two columns get decoded
+            auto base = b * PackedTable::BLOCK;
+            auto col1 = block.column(field1);
+            auto col2 = block.column(field2);
+            if(col1 && col2)
+                product += columnProduct(*col1, *col2, Range{static_cast<unsigned>(max<size_t>(range.first, base) - base),
+                                                             static_cast<unsigned>(min<size_t>(range.second, base + block.size()) - base)});
+        }
+        return product;
+    }
+    void addReadTime(uint64_t ns)
+    {
+        IngestCounters counters{};
+        counters.phaseNs[static_cast<unsigned>(Phase::read)] = ns;
+        stats.addIngest(counters);
+    }
+    static bool isSymbolSet(const string& symbol)
+    {
+        return symbol.find_first_of("*,") != string::npos;
+    }
+    vector<unsigned> selectSymbols(const string& selector) const                //comma separated names or prefixes ending in '*' - matches of a prefix by name, no repeats
+    {
+        vector<unsigned> ids;
+        vector<bool> taken(tick.symbols.size(), false);
+        auto take = [&](unsigned id){
+            if(!taken[id])
             {
-                vector<double> fieldVals = consumeFields(line);
-                symbolDict.insert(symbol);
-                vector<vector<double>> herp{};
-                vector<time_t> derp{};
-                derp.push_back(timeStamp);
-                herp.push_back(fieldVals);
-                symbolTables.emplace(symbol, SymbolTable{derp, herp});
+                taken[id] = true;
+                ids.push_back(id);
             }
-            else                                                                //symbol-specific vector already exists
+        };
+        stringstream items(selector);
+        string item;
+        while(getline(items, item, ','))
+        {
+            if(item.empty() || (item.back() != '*'))
             {
-                auto& times = symbolTables.at(symbol).timestamps;
-                auto& values = symbolTables.at(symbol).values;
-                vector<double> fieldVals = consumeFields(line);
-                times.push_back(timeStamp);
-                values.push_back(fieldVals);
+                auto id = tick.symbols.find(item);
+                if(id != Interner::NONE)
+                    take(id);
+                continue;
             }
+            item.pop_back();
+            vector<unsigned> matches;
+            for(auto id = 0u; id < tick.symbols.size(); ++id)
+                if(tick.symbols.name(id).compare(0, item.size(), item) == 0)
+                    matches.push_back(id);
+            sort(matches.begin(), matches.end(), [&](unsigned a, unsigned b){ return tick.symbols.name(a) < tick.symbols.name(b); });
+            for(auto id : matches)
+                take(id);
         }
+        return ids;
     }
-    time_t consumeTime(string& line)
+    template<typename Query, typename Emit>
+    void fanOut(const vector<unsigned>& symbolIds, Query&& query, Emit&& emit)  //query(id) on the pool, emit(id, result) here in symbolIds order
     {
-        auto firstComa = line.find(",",0);
-        auto time = line.substr(0,firstComa);
-        line = line.substr(firstComa+1);
-        return time_t(atoi(time.c_str()));
+        auto& pool = queryWorkers();
+        deque<future<decltype(query(0u))>> pending;
+        size_t next{0};
+        for(size_t done = 0; done < symbolIds.size(); ++done)
+        {
+            for(; (next < symbolIds.size()) && (pending.size() < 2u * pool.size()); ++next)  //a bounded window - finished results don't pile up
+            {
+                auto symbolId = symbolIds[next];
+                pending.push_back(pool.submit([&query, symbolId](){ return query(symbolId); }));
+            }
+            emit(symbolIds[done], pending.front().get());
+            pending.pop_front();
+        }
     }
-    string consumeString(string& line)
+    ThreadPool& queryWorkers()
     {
-        auto firstComa = line.find(",",0);
-        auto str = line.substr(0, firstComa);
-        line = line.substr(firstComa+1);
-        return str;
+        lock_guard<mutex> lock(queryPoolGuard);
+        if(!queryPool)
+            queryPool.reset(new ThreadPool(queryThreads ? queryThreads : defaultThreadCount()));
+        return *queryPool;
     }
-    double consumeValue(string& line)
+    void printSymbol(ostream& out, unsigned symbolId, time_t startTime, time_t endTime)
     {
-        auto firstComa = line.find(",",0);
-        if(firstComa != line.npos)
+        if(compressed)
+            printPacked(out, packed[symbolId], packed[symbolId].findRange(startTime, endTime));
+        else if(TablePin pin{pager, tick.tables, symbolId})                     //paged back in if it got spilled
+            printRange(out, tick.tables[symbolId], findRange(tick.tables[symbolId], startTime, endTime));
+        else
+            reportPageInFailure(symbolId);
+        for(const auto& segment : segments)                                     //tickfile/follow rows first, then the segments in time order
+            if(auto table = segment->table(symbolId, startTime, endTime))
+                printRange(out, *table, findRange(*table, startTime, endTime));
+    }
+    void reportPageInFailure(unsigned symbolId)                                 //a spilled table that couldn't be read back - its rows are left out of the query
+    {
+        ++stats.pageInFailures;
+        cerr << "cannot page \"" + tick.symbols.name(symbolId) + "\" back in from the spill file\n";   //one write - queries may run concurrently
+    }
+    bool symbolProduct(unsigned symbolId, time_t startTime, time_t endTime, unsigned field1Id, unsigned field2Id, double& product)   //false - no rows in range
+    {
+        auto anyRows = false;
+        product = 0.0;
+        if(compressed)
         {
-            auto val = line.substr(0, firstComa);
-            line = line.substr(firstComa+1);
-            return atof(val.c_str());
+            auto range = packed[symbolId].findRange(startTime, endTime);
+            if(range.first < range.second)
+            {
+                anyRows = true;
+                product += packedProduct(packed[symbolId], range, field1Id, field2Id);
+            }
         }
         else
         {
-            auto val = line.substr(0);
-            line.clear();
-            return atof(val.c_str());
+            TablePin pin(pager, tick.tables, symbolId);
+            if(!pin)
+                reportPageInFailure(symbolId);
+            const auto& table = tick.tables[symbolId];
+            auto range = pin ? findRange(table, startTime, endTime) : Range{0, 0};
+            if(range.first < range.second)
+            {
+                anyRows = true;
+                product += calculateProduct(symbolId, table, range, field1Id, field2Id);
+            }
+        }
+        for(const auto& segment : segments)
+        {
+            auto table = segment->table(symbolId, startTime, endTime);
+            auto range = table ? findRange(*table, startTime, endTime) : Range{0, 0};
+            if(range.first < range.second)
+            {
+                anyRows = true;
+                product += tableProduct(*table, range, field1Id, field2Id);
+            }
         }
+        return anyRows;
     }
-    vector<double> consumeFields(string& line)
+    double calculateProduct(unsigned symbolId, const SymbolTable& table, Range range, unsigned field1, unsigned field2)
     {
-        vector<double> fieldVals(fieldToIdx.size(), NAN);
-        while(!line.empty())
+        if((field1 == Interner::NONE) || (field2 == Interner::NONE))            //the field never showed up in the input file at all
+            return 0.0;
+        auto col1 = table.column(field1);
+        auto col2 = table.column(field2);
+        if(!col1 || !col2)                                                      //...or never for this symbol
+            return 0.0;
+        double product{0};
+        if(prefixSums.rangeProduct(symbolId, field1, field2, *col1, *col2, table.size(), range, product))
+            return product;
+        auto rollup = findRollup(symbolId);
+        auto pairIt = find_if(rollupPairs.begin(), rollupPairs.end(), [&](const pair<unsigned, unsigned>& p){
+            return ((p.first == field1) && (p.second == field2)) || ((p.first == field2) && (p.second == field1));
+        });
+        if(rollup && (pairIt != rollupPairs.end()))                             //whole buckets from the pyramid, only the edges get scanned
+        {
+            auto pairIdx = static_cast<unsigned>(distance(rollupPairs.begin(), pairIt));
+            rollup->cover(range, [&](unsigned level, size_t b){ product += rollup->pairSum(level, b, pairIdx); },
+                                 [&](Range edge){ product += columnProduct(*col1, *col2, edge); });
+            return product;
+        }
+        return columnProduct(*col1, *col2, range);
+    }
+    double tableProduct(const SymbolTable& table, Range range, unsigned field1, unsigned field2) const     //segments - no prefix sums, those are keyed by symbol
+    {
+        if((field1 == Interner::NONE) || (field2 == Interner::NONE))
+            return 0.0;
+        auto col1 = table.column(field1);
+        auto col2 = table.column(field2);
+        return (col1 && col2) ? columnProduct(*col1, *col2, range) : 0.0;
+    }
+    Segment makeSegment(const string& fName, TickData& part)                    //part's names go into the global dictionaries, its columns move to the global ids
+    {
+        Segment segment{};
+        segment.file = fName;
+        vector<unsigned> remap;
+        for(const auto& name : part.fields.allNames())
+            remap.push_back(tick.fields.intern(name));
+        for(auto local = 0u; local < part.tables.size(); ++local)
+        {
+            auto global = tick.symbols.intern(part.symbols.name(local));
+            if(global >= segment.tables.size())
+            {
+                segment.tables.resize(global + 1);
+                segment.bounds.resize(global + 1);
+            }
+            auto& source = part.tables.edit(local);
+            auto& table = segment.tables[global];
+            table.timestamps = move(source.timestamps);
+            for(auto field = 0u; field < source.columns.size(); ++field)
+            {
+                if(remap[field] >= table.columns.size())
+                    table.columns.resize(remap[field] + 1);
+                table.columns[remap[field]] = move(source.columns[field]);
+            }
+            table.index.update(table.timestamps);
+            auto bounds = minmax_element(table.timestamps.begin(), table.timestamps.end());
+            segment.bounds[global] = {*bounds.first, *bounds.second};
+            segment.minTime = (local == 0) ? *bounds.first : min(segment.minTime, *bounds.first);
+            segment.maxTime = (local == 0) ? *bounds.second : max(segment.maxTime, *bounds.second);
+        }
+        tick.tables.resize(tick.symbols.size());                                //every symbol id has a (maybe empty) main table
+        return segment;
+    }
+    virtual IngestCounters readChunk(TickData& target, const char* beg, const char* end) const    //whole lines into target - the tokenizer is a subclass' to swap
+    {
+        TickReader reader(target);
+        reader.readBuffer(beg, end);
+        return reader.ingested();
+    }
+    virtual IngestCounters readStream(TickData& target, istream& in) const
+    {
+        TickReader reader(target);
+        reader.readLines(in);
+        return reader.ingested();
+    }
+    virtual double columnProduct(const Column& col1, const Column& col2, Range range) const
+    {
+        auto rowEnd = min<size_t>(range.second, min(col1.values.size(), col2.values.size()));   //columns end with the last row that had them
+        const auto* vals1 = col1.values.data();
+        const auto* vals2 = col2.values.data();
+        double product{0};
+        for(size_t row = range.first; row < rowEnd; )                           //one bitmap word covers 64 rows - the AND of both tells which of them count
         {
-            string fieldName = consumeString(line);
-            double fieldValue = consumeValue(line);
-            if(fieldToIdx.find(fieldName) != fieldToIdx.end())
+            auto word = row >> 6;
+            auto wordEnd = min<size_t>((word + 1) << 6, rowEnd);
+            auto mask = col1.present[word] & col2.present[word];
+            mask &= ~uint64_t{0} << (row & 63);
+            if(wordEnd & 63)
+                mask &= ~(~uint64_t{0} << (wordEnd & 63));
+            if(mask == ~uint64_t{0})                                            //dense stretch - a plain streaming multiply-accumulate
             {
-                fieldVals[fieldToIdx.at(fieldName)] = fieldValue;
+                for(auto r = row; r < wordEnd; ++r)
+                    product += vals1[r]*vals2[r];
             }
             else
             {
-                fieldToIdx.insert({fieldName, fieldVals.size()});
-                fieldVals.push_back(fieldValue);
-                fieldNames.push_back(fieldName);
+                for(; mask; mask &= mask - 1)
+                {
+                    auto r = (word << 6) + __builtin_ctzll(mask);
+                    product += vals1[r]*vals2[r];
+                }
             }
+            row = wordEnd;
         }
-        return fieldVals;
+        return product;
+    }
+    virtual void printRange(ostream& out, const SymbolTable& table, Range range) const
+    {
+        for(auto row = range.first; row < range.second; ++row)
+        {
+            printRow(out, table, row);
+        }
+    }
+    void printRow(ostream& out, const SymbolTable& table, size_t row) const
+    {
+        string coma="";
+        for(auto i = 0u; i < table.columns.size(); ++i)
+            if(table.columns[i].has(row))
+            {
+                out << coma << tick.fields.name(i) << ":" << std::fixed << std::setprecision(3) << table.columns[i].values[row];
+                coma = ",";
+            }
+        out << "\n";
     }
-
     ifstream data{nullptr};
-    FieldToIdxMap fieldToIdx;
-    SymbolDict symbolDict;
-    vector<string> fieldNames{};
-    map<string, SymbolTable> symbolTables;
+    unsigned ingestThreads{0};
+    PrefixSumCache prefixSums{};
+    map<string, size_t> fileOffsets;                                            //bytes of each regular tick file consumed so far
+    CowVector<Rollup> rollups;                                                  //per symbol, raw storage only
+    vector<pair<unsigned, unsigned>> rollupPairs;                               //field ids whose products the rollups carry
+    bool rollupsOn{false};
+    SymbolPager pager;                                                          //raw tables under a memory budget, off by default
+    unsigned queryThreads{0};
+    unique_ptr<ThreadPool> queryPool;                                           //started on the first symbol set query
+    mutex queryPoolGuard;
 };
 
-class ProductParser : public Parser
+class ProductParser : public Parser                                             //presence masked SIMD kernel over both columns, range split across threads
 {
 public:
-    ProductParser()
-    {
-        cout << "Parser for optimized product operation selected" << endl;      //one day i'll get to it
-    }
     /*it could be better to specialize each method in their dedicated class and encapsulate
      *them in one facade object - goes on the TODO list
      * */
+    void setProductThreads(unsigned threads)                                    //0 lets the hardware & the range length decide
+    {
+        productThreads = threads;
+    }
+private:
+    static constexpr size_t MIN_ROWS_PER_THREAD = 1u << 16;                     //~1MiB of both columns, less than that isn't worth a thread
+    double columnProduct(const Column& col1, const Column& col2, Range range) const override
+    {
+        size_t first = range.first;
+        auto last = min<size_t>(range.second, min(col1.values.size(), col2.values.size()));     //columns end with the last row that had them
+        if(first >= last)
+            return 0.0;
+        auto rows = last - first;
+        auto threads = ThreadPool::onWorker() ? 1u                              //a symbol set or batch query - the pool keeps the cores busy, no threads per call
+                                              : productThreads ? productThreads
+                                              : static_cast<unsigned>(min<size_t>(defaultThreadCount(), max<size_t>(1u, rows / MIN_ROWS_PER_THREAD)));
+        vector<double> partials(threads, 0.0);                                  //each worker accumulates in registers and writes its slot once at the end
+        parallelFor(threads, [&](unsigned t){
+            auto from = first + rows * t / threads;
+            auto to = first + rows * (t + 1) / threads;
+            partials[t] = maskedDot(col1.values.data(), col2.values.data(), col1.present.data(), col2.present.data(), from, to);
+        });
+        double product{0};
+        for(auto partial : partials)                                            //fixed order - the same range always sums up the same way
+            product += partial;
+        return product;
+    }
+
+    unsigned productThreads{0};
 };
 
-class PrintParser : public Parser
+class PrintParser : public Parser                                               //rows are formatted by hand into per-thread buffers, written out in order
 {
 public:
-    PrintParser()
+    void setPrintThreads(unsigned threads)                                      //0 lets the hardware & the range length decide
     {
-        cout << "Parser for optimized printing operation selected" << endl;     //implementation waiting for better days
+        printThreads = threads;
     }
+private:
+    static constexpr size_t MIN_ROWS_PER_THREAD = 1u << 14;
+    static constexpr size_t ROWS_PER_BATCH = 1u << 20;
+    void printRange(ostream& out, const SymbolTable& table, Range range) const override
+    {
+        if(range.first >= range.second)
+            return;
+        vector<string> prefixes;                                                //"name:" for both the first and the following fields
+        for(const auto& name : tick.fields.allNames())
+            prefixes.push_back(name + ":");
+        size_t rows = range.second - range.first;
+        auto threads = ThreadPool::onWorker() ? 1u                              //symbol set fan-out - one buffer, no threads per call
+                                              : printThreads ? printThreads
+                                              : static_cast<unsigned>(min<size_t>(defaultThreadCount(), max<size_t>(1u, rows / MIN_ROWS_PER_THREAD)));
+        vector<string> buffers(threads);
+        for(size_t batchBeg = range.first; batchBeg < range.second; batchBeg += ROWS_PER_BATCH)     //batches keep the buffered output bounded
+        {
+            auto batchEnd = min<size_t>(batchBeg + ROWS_PER_BATCH, range.second);
+            auto batchRows = batchEnd - batchBeg;
+            parallelFor(threads, [&](unsigned t){
+                auto& buffer = buffers[t];
+                buffer.clear();
+                for(auto row = batchBeg + batchRows * t / threads; row < batchBeg + batchRows * (t + 1) / threads; ++row)
+                    formatRow(buffer, table, row, prefixes);
+            });
+            for(const auto& buffer : buffers)
+                out.write(buffer.data(), buffer.size());
+        }
+    }
+    static void formatRow(string& out, const SymbolTable& table, size_t row, const vector<string>& prefixes)
+    {
+        auto first = true;
+        for(auto i = 0u; i < table.columns.size(); ++i)
+            if(table.columns[i].has(row))
+            {
+                if(!first)
+                    out += ',';
+                out += prefixes[i];
+                appendFixed3(out, table.columns[i].values[row]);
+                first = false;
+            }
+        out += '\n';
+    }
+
+    unsigned printThreads{0};
 };
@@ -0,0 +1,165 @@
+#pragma once
+#include <list>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include "symboltable.hpp"
+
+/* Running sums of col1[r]*col2[r] per (symbol, field1, field2) - once built, a range product is two lookups.
+ * The sums are carried compensated (Neumaier) and both halves are stored, so even a long prefix gives the same
+ * digits as summing the range directly. Entries get built on first use, extended when rows are appended and
+ * evicted least recently used first once the byte budget is exceeded. A budget of 0 turns the whole thing off.
+ */
+class PrefixSumCache
+{
+public:
+    void setBudget(size_t maxBytes)
+    {
+        lock_guard<mutex> lock(guard);
+        budget = maxBytes;
+        evictFor(0);
+    }
+    size_t budgetBytes() const                                                  //locked like the writes - queries ask while setBudget runs
+    {
+        lock_guard<mutex> lock(guard);
+        return budget;
+    }
+    bool enabled() const
+    {
+        lock_guard<mutex> lock(guard);
+        return budget > 0;
+    }
+    size_t usedBytes() const
+    {
+        lock_guard<mutex> lock(guard);
+        return used;
+    }
+    void clear()                                                                //for when tables get rebuilt rather than appended to
+    {
+        lock_guard<mutex> lock(guard);
+        entries.clear();
+        lru.clear();
+        used = 0;
+    }
+    bool rangeProduct(unsigned symbol, unsigned field1, unsigned field2,        //false - not cacheable within the budget, go scan
+                      const Column& col1, const Column& col2, size_t rows, Range range, double& product)
+    {
+        if(!enabled())
+            return false;
+        auto swapped = field2 < field1;                                         //f1*f2 == f2*f1, one entry serves both
+        if(swapped)
+            swap(field1, field2);
+        const auto& first = swapped ? col2 : col1;
+        const auto& second = swapped ? col1 : col2;
+        lock_guard<mutex> lock(guard);
+        Key key{symbol, field1, field2};
+        auto entryIt = entries.find(key);
+        if((entryIt != entries.end()) && (entryIt->second.rows > rows))         //table got smaller - can't be trusted anymore
+        {
+            drop(entryIt);
+            entryIt = entries.end();
+        }
+        auto extra = entryBytes(rows) - (entryIt != entries.end() ? entryBytes(entryIt->second.rows) : 0u);
+        if(entryBytes(rows) > budget)
+        {
+            if(entryIt != entries.end())
+                drop(entryIt);
+            return false;
+        }
+        if(entryIt == entries.end())
+        {
+            evictFor(extra);
+            entryIt = entries.insert({key, Entry{}}).first;
+            lru.push_front(key);
+            entryIt->second.lruPos = lru.begin();
+        }
+        else
+        {
+            lru.splice(lru.begin(), lru, entryIt->second.lruPos);
+            if(extra)
+            {
+                auto keep = entryIt->first;
+                evictFor(extra, &keep);
+            }
+        }
+        auto& entry = entryIt->second;
+        if(entry.rows < rows)
+        {
+            extend(entry, first, second, rows);
+            used += extra;
+        }
+        auto badIt = lower_bound(entry.nonFinite.begin(), entry.nonFinite.end(), range.first);
+        if((badIt != entry.nonFinite.end()) && (*badIt < range.second))       //a nan/inf product in range - the scan gives what it gives
+            return false;
+        product = (entry.hi[range.second] - entry.hi[range.first]) + (entry.lo[range.second] - entry.lo[range.first]);
+        return true;
+    }
+private:
+    using Key = tuple<unsigned, unsigned, unsigned>;                            //symbol & field ids
+    struct Entry
+    {
+        vector<double> hi{0.0};                                                 //hi[r] + lo[r] - sum of the first r products
+        vector<double> lo{0.0};
+        double sum{0};
+        double compensation{0};
+        size_t rows{0};
+        vector<size_t> nonFinite;                                               //rows whose product stays out of the sums, they'd poison every later prefix
+        list<Key>::iterator lruPos;
+    };
+    static size_t entryBytes(size_t rows)
+    {
+        return 2 * sizeof(double) * (rows + 1);
+    }
+    static void extend(Entry& entry, const Column& col1, const Column& col2, size_t rows)
+    {
+        entry.hi.reserve(rows + 1);
+        entry.lo.reserve(rows + 1);
+        for(auto row = entry.rows; row < rows; ++row)
+        {
+            if(col1.has(row) && col2.has(row))
+            {
+                auto term = col1.values[row]*col2.values[row];
+                if(!isfinite(term))
+                {
+                    entry.nonFinite.push_back(row);
+                    term = 0.0;
+                }
+                auto total = entry.sum + term;
+                if(fabs(entry.sum) >= fabs(term))
+                    entry.compensation += (entry.sum - total) + term;
+                else
+                    entry.compensation += (term - total) + entry.sum;
+                entry.sum = total;
+            }
+            entry.hi.push_back(entry.sum);
+            entry.lo.push_back(entry.compensation);
+        }
+        entry.rows = rows;
+    }
+    void drop(map<Key, Entry>::iterator entryIt)
+    {
+        used -= entryBytes(entryIt->second.rows);
+        lru.erase(entryIt->second.lruPos);
+        entries.erase(entryIt);
+    }
+    void evictFor(size_t bytes, const Key* keep = nullptr)                      //least recently used go first, 'keep' is the one about to grow
+    {
+        while((used + bytes > budget) && !lru.empty())
+        {
+            auto victim = prev(lru.end());
+            if(keep && (*victim == *keep))
+            {
+                if(lru.size() == 1)
+                    break;
+                victim = prev(victim);
+            }
+            drop(entries.find(*victim));
+        }
+    }
+
+    mutable mutex guard;
+    map<Key, Entry> entries;
+    list<Key> lru;                                                              //most recently used in front
+    size_t budget{0};
+    size_t used{0};
+};
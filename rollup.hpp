@@ -0,0 +1,207 @@
+#pragma once
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <limits>
+#include <cstdint>
+#include "symboltable.hpp"
+
+/* Rollup pyramid of one symbol - per minute, hour and day bucket: count/sum/min/max of every field and the sums of the
+ * selected field pairs' products. Buckets are aligned to the epoch and only the non-empty ones are kept, each knows the first
+ * row it covers. Appended rows extend the minute level, the coarser levels are re-merged from the minute buckets that changed.
+ * A range query takes whole buckets from the coarsest level that fits, finer levels fill in the edges and what no bucket
+ * covers in full is left to the raw rows. Needs rows in time order, which ingest sees to - a symbol that isn't keeps no rollup.
+ */
+struct FieldBucket
+{
+    uint32_t count{0};
+    double sum{0};
+    double min{std::numeric_limits<double>::infinity()};
+    double max{-std::numeric_limits<double>::infinity()};
+    void add(double value)
+    {
+        ++count;
+        sum += value;
+        min = value < min ? value : min;
+        max = value > max ? value : max;
+    }
+    void merge(const FieldBucket& other)
+    {
+        count += other.count;
+        sum += other.sum;
+        min = other.min < min ? other.min : min;
+        max = other.max > max ? other.max : max;
+    }
+};
+
+class Rollup
+{
+public:
+    enum : unsigned { LEVELS = 3u };
+    static time_t width(unsigned level)                                         //seconds per bucket
+    {
+        static const time_t WIDTHS[LEVELS] = {60, 3600, 86400};
+        return WIDTHS[level];
+    }
+    bool valid() const
+    {
+        return sorted;
+    }
+    size_t rowsCovered() const                                                  //update() has nothing to do while the table has this many
+    {
+        return rows;
+    }
+    size_t bytes() const
+    {
+        size_t total{0};
+        for(const auto& level : levels)
+        {
+            total += level.starts.capacity() * sizeof(time_t) + level.firstRow.capacity() * sizeof(size_t);
+            for(const auto& field : level.fields)
+                total += field.capacity() * sizeof(FieldBucket);
+            for(const auto& pair : level.pairs)
+                total += pair.capacity() * sizeof(double);
+        }
+        return total;
+    }
+    void update(const SymbolTable& table, const vector<pair<unsigned, unsigned>>& pairs)  //extends over the rows appended since the last call
+    {
+        if((table.size() < rows) || (pairs.size() != pairCount))                //table rebuilt underneath or another pair selection - start over
+            *this = Rollup{};
+        pairCount = pairs.size();
+        sorted = sorted && table.index.sorted;
+        if(!sorted)
+        {
+            levels = vector<Level>(LEVELS);
+            return;
+        }
+        if(table.size() == rows)
+            return;
+        auto& fine = levels[0];
+        auto fields = table.columns.size();
+        for(auto& level : levels)
+        {
+            if(level.fields.size() < fields)                                    //a field this symbol hadn't carried before
+                level.fields.resize(fields, vector<FieldBucket>(level.starts.size()));
+            level.pairs.resize(pairs.size(), vector<double>(level.starts.size(), 0.0));
+        }
+        auto firstChanged = fine.starts.empty() ? 0u : fine.starts.size() - 1;
+        if(!fine.starts.empty() && (bucketStart(table.timestamps[rows], 0) != fine.starts.back()))
+            ++firstChanged;
+        for(auto row = rows; row < table.size(); ++row)
+        {
+            auto start = bucketStart(table.timestamps[row], 0);
+            if(fine.starts.empty() || (fine.starts.back() != start))
+                fine.push(start, row);
+            auto b = fine.starts.size() - 1;
+            for(auto field = 0u; field < fields; ++field)
+                if(table.columns[field].has(row))
+                    fine.fields[field][b].add(table.columns[field].values[row]);
+            for(auto p = 0u; p < pairs.size(); ++p)
+            {
+                auto col1 = table.column(pairs[p].first), col2 = table.column(pairs[p].second);
+                if(col1 && col2 && col1->has(row) && col2->has(row))
+                    fine.pairs[p][b] += col1->values[row] * col2->values[row];
+            }
+        }
+        rows = table.size();
+        for(auto level = 1u; level < LEVELS; ++level)                          //coarse buckets from the first changed fine one on get merged again
+        {
+            auto& finer = levels[level - 1];
+            auto& coarse = levels[level];
+            auto start = bucketStart(finer.starts[firstChanged], level);
+            while(!coarse.starts.empty() && (coarse.starts.back() >= start))
+                coarse.pop();
+            firstChanged = coarse.starts.size();
+            for(auto b = static_cast<size_t>(distance(finer.starts.begin(), lower_bound(finer.starts.begin(), finer.starts.end(), start)));
+                b < finer.starts.size(); ++b)
+            {
+                auto coarseStart = bucketStart(finer.starts[b], level);
+                if(coarse.starts.empty() || (coarse.starts.back() != coarseStart))
+                    coarse.push(coarseStart, finer.firstRow[b]);
+                auto c = coarse.starts.size() - 1;
+                for(auto field = 0u; field < fields; ++field)
+                    coarse.fields[field][c].merge(finer.fields[field][b]);
+                for(auto p = 0u; p < pairs.size(); ++p)
+                    coarse.pairs[p][c] += finer.pairs[p][b];
+            }
+        }
+    }
+    template<typename Bucket, typename Raw>
+    void cover(Range range, Bucket&& bucket, Raw&& raw) const                   //bucket(level, b) for whole buckets, raw(Range) for the rest
+    {
+        cover(LEVELS, range.first, range.second, bucket, raw);
+    }
+    const FieldBucket& fieldBucket(unsigned level, size_t b, unsigned field) const    //an empty one if the field came later
+    {
+        static const FieldBucket EMPTY{};
+        return field < levels[level].fields.size() ? levels[level].fields[field][b] : EMPTY;
+    }
+    double pairSum(unsigned level, size_t b, unsigned pairIdx) const
+    {
+        return levels[level].pairs[pairIdx][b];
+    }
+private:
+    struct Level
+    {
+        vector<time_t> starts;
+        vector<size_t> firstRow;
+        vector<vector<FieldBucket>> fields;                                     //[field][bucket]
+        vector<vector<double>> pairs;                                           //[pair][bucket]
+        void push(time_t start, size_t row)
+        {
+            starts.push_back(start);
+            firstRow.push_back(row);
+            for(auto& field : fields)
+                field.emplace_back();
+            for(auto& pair : pairs)
+                pair.push_back(0.0);
+        }
+        void pop()
+        {
+            starts.pop_back();
+            firstRow.pop_back();
+            for(auto& field : fields)
+                field.pop_back();
+            for(auto& pair : pairs)
+                pair.pop_back();
+        }
+    };
+
+    static time_t bucketStart(time_t time, unsigned level)                      //floor - pre-1970 timestamps included
+    {
+        auto w = width(level);
+        return (time >= 0 ? time / w : -((-time + w - 1) / w)) * w;
+    }
+    template<typename Bucket, typename Raw>
+    void cover(unsigned level, size_t first, size_t last, Bucket& bucket, Raw& raw) const
+    {
+        if(first >= last)
+            return;
+        if(level == 0)
+        {
+            raw(Range{static_cast<unsigned>(first), static_cast<unsigned>(last)});
+            return;
+        }
+        const auto& rowStarts = levels[level - 1].firstRow;
+        auto count = rowStarts.size();
+        auto b0 = static_cast<size_t>(distance(rowStarts.begin(), lower_bound(rowStarts.begin(), rowStarts.end(), first)));
+        auto b1 = b0;                                                           //buckets [b0, b1) lie inside [first, last)
+        while((b1 < count) && ((b1 + 1 < count ? rowStarts[b1 + 1] : rows) <= last))
+            ++b1;
+        if(b0 >= b1)
+        {
+            cover(level - 1, first, last, bucket, raw);
+            return;
+        }
+        cover(level - 1, first, rowStarts[b0], bucket, raw);
+        for(auto b = b0; b < b1; ++b)
+            bucket(level - 1, b);
+        cover(level - 1, b1 < count ? rowStarts[b1] : rows, last, bucket, raw);
+    }
+
+    vector<Level> levels = vector<Level>(LEVELS);
+    size_t rows{0};                                                             //rows covered so far
+    size_t pairCount{0};
+    bool sorted{true};
+};
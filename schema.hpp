@@ -0,0 +1,104 @@
+#pragma once
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include "parser.hpp"
+
+/* Schema specialized ingest - for feeds whose field set is known when the parser gets compiled. A FieldSchema<F...> line
+ * reader matches the field names against the schema in order, one fixed length compare each, and parses the values into a
+ * fixed row - a value slot plus a presence bit per schema field - so which column a value lands in is settled at compile time.
+ * Lines may leave out any schema field; a line with fields out of schema order, repeated or unknown ones is left alone and
+ * takes the generic path instead, name by name. Column ids are still handed out in order of first appearance, so the tables
+ * (and the output) are the same as the generic Parser's.
+ */
+#define GS_SCHEMA_FIELD(Type, text)                                             \
+    struct Type                                                                 \
+    {                                                                           \
+        static const char* name() { return text; }                              \
+        enum : size_t { LENGTH = sizeof(text) - 1 };                            \
+    }
+
+template<typename... Fields>
+class FieldSchema
+{
+public:
+    enum : size_t { COUNT = sizeof...(Fields) };
+    static_assert(COUNT > 0 && COUNT <= 64, "one presence word per row");
+    explicit FieldSchema(Interner& names) : fields(names)
+    {
+        for(auto& id : ids)
+            id = Interner::NONE;
+    }
+    bool parse(StrRef line)                                                     //false - the line doesn't follow the schema, nothing kept
+    {
+        present = 0;
+        return match<0>(line, List<Fields...>{}) && line.empty();
+    }
+    void store(SymbolTable& table, size_t row)                                  //the values of the last parse into 'row'
+    {
+        store<0>(table, row, List<Fields...>{});
+    }
+private:
+    template<typename...> struct List {};
+
+    template<size_t K>
+    bool match(StrRef&, List<>)
+    {
+        return true;
+    }
+    template<size_t K, typename Field, typename... Rest>
+    bool match(StrRef& line, List<Field, Rest...>)                              //Field is either next in the line or absent from it
+    {
+        if(line.empty())
+            return true;
+        if((line.len > Field::LENGTH) && (line.ptr[Field::LENGTH] == ',') && (memcmp(line.ptr, Field::name(), Field::LENGTH) == 0))
+        {
+            auto value = line.ptr + Field::LENGTH + 1;
+            auto valueEnd = static_cast<const char*>(memchr(value, ',', line.len - Field::LENGTH - 1));
+            auto lineEnd = line.ptr + line.len;
+            valueEnd = valueEnd ? valueEnd : lineEnd;
+            values[K] = numparse::parseDecimal(value, static_cast<size_t>(valueEnd - value));
+            present |= uint64_t{1} << K;
+            line = valueEnd < lineEnd ? StrRef{valueEnd + 1, static_cast<size_t>(lineEnd - valueEnd - 1)} : StrRef{lineEnd, 0};
+        }
+        return match<K + 1>(line, List<Rest...>{});
+    }
+    template<size_t K>
+    void store(SymbolTable&, size_t, List<>)
+    {
+    }
+    template<size_t K, typename Field, typename... Rest>
+    void store(SymbolTable& table, size_t row, List<Field, Rest...>)
+    {
+        if(present & (uint64_t{1} << K))
+        {
+            if(ids[K] == Interner::NONE)                                        //first sight of the field in this TickData
+                ids[K] = fields.intern(Field::name(), Field::LENGTH);
+            table.set(row, ids[K], values[K]);
+        }
+        store<K + 1>(table, row, List<Rest...>{});
+    }
+
+    Interner& fields;
+    unsigned ids[COUNT];                                                        //column id of each schema field, NONE until it shows up
+    double values[COUNT];                                                       //the row of the last parse...
+    uint64_t present{0};                                                        //...and which of its slots are set
+};
+
+template<typename Schema, typename Base = Parser>
+class SchemaParser : public Base                                                //Base's queries over tables filled by the schema's tokenizer
+{
+private:
+    IngestCounters readChunk(TickData& target, const char* beg, const char* end) const override
+    {
+        BasicTickReader<Schema> reader(target);
+        reader.readBuffer(beg, end);
+        return reader.ingested();
+    }
+    IngestCounters readStream(TickData& target, istream& in) const override
+    {
+        BasicTickReader<Schema> reader(target);
+        reader.readLines(in);
+        return reader.ingested();
+    }
+};
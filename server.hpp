@@ -0,0 +1,278 @@
+#pragma once
+#include <string>
+#include <sstream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <streambuf>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "parser.hpp"
+
+/* Server mode - many clients share one loaded dataset over a Unix domain socket, a thread per client. One command per line,
+ * the reply is the command's output followed by a status line: "ok <version>" or "err <reason>".
+ * Queries run against the version that was current when they started - a Parser nobody ingests into anymore, kept alive by
+ * shared_ptr for as long as some query holds it. Loads are serialized among themselves: the writer copies the current version,
+ * ingests into the copy and publishes it with one atomic pointer store. Readers never wait for an ingest to finish and an
+ * ingest never waits for readers to drain. The copy shares the per symbol tables (see cowvector.hpp), only the symbols an
+ * ingest appends to get copied - a version costs about what its load touched.
+ */
+class SocketBuffer : public streambuf                                           //buffered writes to a connected socket, failures make the stream bad
+{
+public:
+    explicit SocketBuffer(int socketFd) : fd(socketFd), buffer(1u << 16)
+    {
+        setp(buffer.data(), buffer.data() + buffer.size());
+    }
+    ~SocketBuffer()
+    {
+        sync();
+    }
+protected:
+    int overflow(int c) override
+    {
+        if(sync() != 0)
+            return traits_type::eof();
+        if(c != traits_type::eof())
+        {
+            *pptr() = static_cast<char>(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+    int sync() override
+    {
+        for(auto first = pbase(); first < pptr(); )
+        {
+            auto sent = send(fd, first, static_cast<size_t>(pptr() - first), MSG_NOSIGNAL);
+            if(sent <= 0)
+                return -1;
+            first += sent;
+        }
+        setp(buffer.data(), buffer.data() + buffer.size());
+        return 0;
+    }
+private:
+    int fd;
+    vector<char> buffer;
+};
+
+class QueryServer
+{
+public:
+    using Factory = function<unique_ptr<Parser>()>;                            //the parser flavour every version is made of
+    static constexpr size_t MAX_LINE = 1u << 20;                                //longer command lines get the client dropped
+    struct Version
+    {
+        uint64_t number;
+        unique_ptr<Parser> parser;                                              //queries only once published
+    };
+    explicit QueryServer(Factory factory) : make(move(factory))
+    {
+        current = make_shared<const Version>(Version{0u, make()});
+    }
+    ~QueryServer()
+    {
+        stop();
+    }
+    bool listen(const string& path)                                             //false - path too long or the socket can't be bound
+    {
+        sockaddr_un address{};
+        if(path.size() >= sizeof(address.sun_path))
+            return false;
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+        listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(listenFd < 0)
+            return false;
+        unlink(path.c_str());                                                   //a socket file left behind by a previous run
+        if((::bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) || (::listen(listenFd, SOMAXCONN) != 0))
+        {
+            close(listenFd);
+            listenFd = -1;
+            return false;
+        }
+        socketPath = path;
+        return true;
+    }
+    void run()                                                                  //accepts clients until stop()
+    {
+        while(!stopping)
+        {
+            auto clientFd = accept(listenFd, nullptr, nullptr);
+            if(clientFd < 0)
+            {
+                if(stopping || (errno != EINTR))
+                    break;
+                continue;
+            }
+            lock_guard<mutex> lock(clientsGuard);
+            clientFds.push_back(clientFd);
+            thread([this, clientFd](){ serve(clientFd); }).detach();             //a client leaves nothing behind once it disconnects
+        }
+        {
+            unique_lock<mutex> lock(clientsGuard);
+            for(auto fd : clientFds)                                            //wakes up clients blocked in recv
+                shutdown(fd, SHUT_RDWR);
+            clientsDone.wait(lock, [this](){ return clientFds.empty(); });
+        }
+        close(listenFd);
+        listenFd = -1;
+        unlink(socketPath.c_str());
+    }
+    void stop()
+    {
+        stopping = true;
+        if(listenFd >= 0)
+            shutdown(listenFd, SHUT_RDWR);                                      //makes the blocked accept return
+    }
+    shared_ptr<const Version> snapshot() const
+    {
+        return atomic_load(&current);
+    }
+    bool publish(const function<bool(Parser&)>& change)                         //change applied to a copy of the current version, published if it says so
+    {
+        lock_guard<mutex> lock(writerGuard);
+        auto base = snapshot();
+        auto next = make();
+        next->copyDataFrom(*base->parser);
+        if(!change(*next))
+            return false;
+        atomic_store(&current, shared_ptr<const Version>(make_shared<const Version>(Version{base->number + 1, move(next)})));
+        return true;
+    }
+    void execute(const string& line, ostream& out)                              //one command, reply & status line included
+    {
+        stringstream inputStr(line);
+        string cmd, sym, f1, f2, file;
+        time_t s, e;
+        size_t mib;
+        if(!(inputStr >> cmd))
+            return;
+        auto version = snapshot();
+        auto& parser = *version->parser;
+        auto ok = true;
+        if((cmd == "print") && (inputStr >> s >> e >> sym))
+            parser.print(s, e, sym, out);
+        else if((cmd == "product") && (inputStr >> s >> e >> sym >> f1 >> f2))
+        {
+            string total;
+            parser.product(s, e, sym, f1, f2, (inputStr >> total) && (total == "total"), out);
+        }
+        else if((cmd == "agg") && (inputStr >> f1 >> s >> e >> sym))
+        {
+            vector<string> exprs;
+            while(inputStr >> f2)
+                exprs.push_back(f2);
+            ok = parser.aggregate(s, e, sym, f1, exprs, out);
+        }
+        else if(cmd == "stats")
+            parser.printStats(out);
+        else if(cmd == "version")
+            ;
+        else if((cmd == "save") && (inputStr >> file))
+            ok = parser.saveSnapshot(file);                                     //reads the version only, nothing to publish
+        else if(((cmd == "tickfile") || (cmd == "follow") || (cmd == "tickfiles") || (cmd == "unload") || (cmd == "load")) && (inputStr >> file))
+        {
+            ok = publish([&](Parser& next){
+                if(cmd == "tickfile")
+                    return next.openTickFile(file);
+                if(cmd == "follow")
+                    return next.followTickFile(file);
+                if(cmd == "tickfiles")
+                    return next.openTickFiles(file) > 0;
+                if(cmd == "unload")
+                    return next.unloadTickFile(file);
+                return next.loadSnapshot(file);
+            });
+            version = snapshot();
+        }
+        else if((cmd == "compress") && (inputStr >> file) && ((file == "on") || (file == "off")))
+        {
+            publish([&](Parser& next){ next.setCompressedStorage(file == "on"); return true; });
+            version = snapshot();
+        }
+        else if((cmd == "rollup") && (inputStr >> file) && ((file == "on") || (file == "off")))
+        {
+            vector<pair<string, string>> pairs;
+            while(inputStr >> f1)
+            {
+                auto star = f1.find('*');
+                if(star != string::npos)
+                    pairs.push_back({f1.substr(0, star), f1.substr(star + 1)});
+            }
+            ok = publish([&](Parser& next){ return next.setRollups(file == "on", pairs); });
+            version = snapshot();
+        }
+        else if((cmd == "prefixsums") && (inputStr >> mib))                     //the budget carries over to later versions
+        {
+            publish([&](Parser& next){ next.setPrefixSumBudget(mib << 20); return true; });
+            version = snapshot();
+        }
+        else
+        {
+            out << "err nope\n";
+            return;
+        }
+        if(ok)
+            out << "ok " << version->number << "\n";
+        else
+            out << "err " << cmd << " failed\n";
+    }
+private:
+    void serve(int clientFd)
+    {
+        {
+            SocketBuffer socketBuffer(clientFd);
+            ostream out(&socketBuffer);
+            converse(clientFd, out);
+        }
+        lock_guard<mutex> lock(clientsGuard);
+        clientFds.erase(find(clientFds.begin(), clientFds.end(), clientFd));
+        close(clientFd);
+        clientsDone.notify_all();
+    }
+    void converse(int clientFd, ostream& out)
+    {
+        string pending;
+        char chunk[4096];
+        while(out)
+        {
+            auto received = recv(clientFd, chunk, sizeof(chunk), 0);
+            if(received <= 0)
+                break;
+            pending.append(chunk, static_cast<size_t>(received));
+            size_t first{0};
+            for(auto eol = pending.find('\n'); (eol != string::npos) && (eol - first <= MAX_LINE); eol = pending.find('\n', first))
+            {
+                execute(pending.substr(first, eol - first), out);
+                first = eol + 1;
+            }
+            out.flush();                                                        //replies go out once the lines received so far are done
+            pending.erase(0, first);
+            if(pending.size() > MAX_LINE)                                       //a line past the cap, ended or not - what's held stays bounded
+            {
+                out << "err line too long\n";
+                break;
+            }
+        }
+    }
+
+    Factory make;
+    shared_ptr<const Version> current;                                          //only ever touched through atomic_load/atomic_store
+    mutex writerGuard;
+    atomic<int> listenFd{-1};
+    string socketPath;
+    atomic<bool> stopping{false};
+    mutex clientsGuard;
+    condition_variable clientsDone;
+    vector<int> clientFds;                                                      //connected clients
+};
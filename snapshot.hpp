@@ -0,0 +1,256 @@
+#pragma once
+#include <string>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <functional>
+#include "symboltable.hpp"
+#include "mappedfile.hpp"
+
+/* Binary columnar snapshot of a TickData - written by `save`, mapped back by `load` without any text parsing.
+ * Layout (native byte order, every item padded to 8 bytes):
+ *   header:  magic "GSSNAPSH" | u32 version | u32 byte order mark | u64 payload bytes | u64 payload checksum
+ *   payload: u64 field count, per field: u64 length, name
+ *            u64 symbol count, per symbol: u64 length, name, u64 rows, u64 columns, i64 timestamps[rows],
+ *                                          per column: u64 value count, f64 values[count], u64 presence words[(count+63)/64]
+ * The checksum covers the whole payload, so truncated or scribbled on files are turned away before anything is read.
+ */
+enum class SnapshotStatus
+{
+    ok,
+    unreadable,
+    notASnapshot,
+    versionMismatch,
+    corrupt
+};
+
+namespace snapshot
+{
+constexpr char MAGIC[8] = {'G','S','S','N','A','P','S','H'};
+constexpr uint32_t VERSION = 1u;
+constexpr uint32_t BYTE_ORDER_MARK = 0x01020304u;                               //reads differently on a foreign endian box
+constexpr size_t HEADER_BYTES = 32u;
+static_assert(sizeof(time_t) == sizeof(int64_t), "timestamps are stored as 64 bit");
+
+inline size_t padded(size_t bytes)
+{
+    return (bytes + 7u) & ~size_t{7u};
+}
+
+inline uint64_t checksum(uint64_t hash, const uint64_t* words, size_t count)   //multiply-rotate over 64 bit words - cheap enough to run at memory speed
+{
+    for(size_t i = 0; i < count; ++i)
+    {
+        hash ^= words[i] * 0x9E3779B97F4A7C15ull;
+        hash = ((hash << 27) | (hash >> 37)) * 0xC2B2AE3D27D4EB4Full;
+    }
+    return hash;
+}
+
+class Writer
+{
+public:
+    explicit Writer(ostream& target) : out(target){};
+    void put(const void* bytes, size_t length)
+    {
+        if(length == 0)
+            return;
+        if(length % 8u == 0)                                                    //columns & co. - hashed and written in place
+        {
+            hash = checksum(hash, static_cast<const uint64_t*>(bytes), length / 8u);
+            out.write(static_cast<const char*>(bytes), length);
+            written += length;
+            return;
+        }
+        buffer.assign(padded(length) / 8u, 0u);
+        memcpy(buffer.data(), bytes, length);
+        hash = checksum(hash, buffer.data(), buffer.size());
+        out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * 8u);
+        written += buffer.size() * 8u;
+    }
+    void putWord(uint64_t word)
+    {
+        put(&word, sizeof(word));
+    }
+    void putString(const string& str)
+    {
+        putWord(str.size());
+        put(str.data(), str.size());
+    }
+    uint64_t hash{0};
+    uint64_t written{0};
+private:
+    ostream& out;
+    vector<uint64_t> buffer;
+};
+
+class Reader                                                                    //bounds checked walk over the mapped payload
+{
+public:
+    Reader(const char* beg, size_t length) : cur(beg), end(beg + length){};
+    bool get(void* bytes, size_t length)
+    {
+        if(static_cast<size_t>(end - cur) < padded(length))
+            return false;
+        if(length)
+            memcpy(bytes, cur, length);
+        cur += padded(length);
+        return true;
+    }
+    bool getWord(uint64_t& word)
+    {
+        return get(&word, sizeof(word));
+    }
+    bool getString(string& str)
+    {
+        uint64_t length;
+        if(!getWord(length) || (length > static_cast<size_t>(end - cur)))
+            return false;
+        str.assign(cur, length);
+        cur += padded(length);
+        return true;
+    }
+    template<typename T>
+    bool getArray(vector<T>& items, uint64_t count)                             //one bulk copy straight out of the mapping
+    {
+        if(count > static_cast<size_t>(end - cur) / sizeof(T))
+            return false;
+        items.resize(count);
+        return get(items.data(), count * sizeof(T));
+    }
+    bool atEnd() const
+    {
+        return cur == end;
+    }
+private:
+    const char* cur;
+    const char* end;
+};
+inline void putTable(Writer& writer, const SymbolTable& table)                 //rows, columns, timestamps & the columns - the per symbol part of the payload
+{
+    writer.putWord(table.size());
+    writer.putWord(table.columns.size());
+    writer.put(table.timestamps.data(), table.timestamps.size() * sizeof(time_t));
+    for(const auto& column : table.columns)
+    {
+        writer.putWord(column.values.size());
+        writer.put(column.values.data(), column.values.size() * sizeof(double));
+        writer.put(column.present.data(), column.present.size() * sizeof(uint64_t));
+    }
+}
+
+inline bool getTable(Reader& reader, uint64_t maxColumns, SymbolTable& table)  //false - doesn't add up, table is left half filled
+{
+    uint64_t rows, columns;
+    if(!reader.getWord(rows) || !reader.getWord(columns) || (columns > maxColumns) || !reader.getArray(table.timestamps, rows))
+        return false;
+    table.columns.resize(columns);
+    for(auto& column : table.columns)
+    {
+        uint64_t count;
+        if(!reader.getWord(count) || (count > rows)
+           || !reader.getArray(column.values, count) || !reader.getArray(column.present, (count + 63u) / 64u))
+            return false;
+    }
+    return true;
+}
+} //eof snapshot namespace
+
+template<typename VisitTable>
+bool writeSnapshot(const Interner& fields, const Interner& symbols, size_t symbolCount, VisitTable&& visitTable,
+                   const string& path)                                          //visitTable(id, f) calls f with the table of symbol id, false - give up
+{
+    auto tmpPath = path + ".tmp";                                               //goes to a temporary first, a crash never leaves a half written snapshot behind
+    ofstream out(tmpPath, ios::out | ios::binary | ios::trunc);
+    if(!out)
+        return false;
+    out.write(string(snapshot::HEADER_BYTES, '\0').data(), snapshot::HEADER_BYTES);
+    snapshot::Writer writer(out);
+    writer.putWord(fields.size());
+    for(const auto& name : fields.allNames())
+        writer.putString(name);
+    writer.putWord(symbolCount);
+    for(auto symbolId = 0u; symbolId < symbolCount; ++symbolId)              //in id order, so ids survive the round trip
+    {
+        writer.putString(symbols.name(symbolId));
+        if(!visitTable(symbolId, [&](const SymbolTable& table){ snapshot::putTable(writer, table); }))
+        {
+            out.close();
+            remove(tmpPath.c_str());
+            return false;
+        }
+    }
+    char header[snapshot::HEADER_BYTES];
+    memcpy(header, snapshot::MAGIC, 8);
+    memcpy(header + 8, &snapshot::VERSION, 4);
+    memcpy(header + 12, &snapshot::BYTE_ORDER_MARK, 4);
+    memcpy(header + 16, &writer.written, 8);
+    memcpy(header + 24, &writer.hash, 8);
+    out.seekp(0);
+    out.write(header, sizeof(header));
+    out.close();
+    if(!out || (rename(tmpPath.c_str(), path.c_str()) != 0))
+    {
+        remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+inline bool writeSnapshot(const TickData& tick, const string& path)
+{
+    return writeSnapshot(tick.fields, tick.symbols, tick.tables.size(), [&](unsigned symbolId, const function<void(const SymbolTable&)>& put){
+        put(tick.tables[symbolId]);
+        return true;
+    }, path);
+}
+
+inline SnapshotStatus readSnapshot(TickData& tick, const string& path)         //tick is only touched once the whole snapshot checked out
+{
+    MappedFile mapped(path);
+    if(!mapped)
+        return SnapshotStatus::unreadable;
+    if((mapped.size() < snapshot::HEADER_BYTES) || (memcmp(mapped.data(), snapshot::MAGIC, 8) != 0))
+        return SnapshotStatus::notASnapshot;
+    uint32_t version, byteOrder;
+    uint64_t payloadBytes, hash;
+    memcpy(&version, mapped.data() + 8, 4);
+    memcpy(&byteOrder, mapped.data() + 12, 4);
+    memcpy(&payloadBytes, mapped.data() + 16, 8);
+    memcpy(&hash, mapped.data() + 24, 8);
+    if((version != snapshot::VERSION) || (byteOrder != snapshot::BYTE_ORDER_MARK))
+        return SnapshotStatus::versionMismatch;
+    const auto* payload = mapped.data() + snapshot::HEADER_BYTES;
+    if((payloadBytes != mapped.size() - snapshot::HEADER_BYTES) || (payloadBytes % 8u)
+       || (snapshot::checksum(0u, reinterpret_cast<const uint64_t*>(payload), payloadBytes / 8u) != hash))  //mmap'ed memory is page aligned, the header keeps the payload 8 aligned
+        return SnapshotStatus::corrupt;
+
+    TickData loaded{};
+    snapshot::Reader reader(payload, payloadBytes);
+    uint64_t fieldCount, symbolCount;
+    if(!reader.getWord(fieldCount))
+        return SnapshotStatus::corrupt;
+    for(uint64_t i = 0; i < fieldCount; ++i)
+    {
+        string name;
+        if(!reader.getString(name) || (loaded.fields.intern(name) != i))        //a repeated name would come back with an old id
+            return SnapshotStatus::corrupt;
+    }
+    if(!reader.getWord(symbolCount))
+        return SnapshotStatus::corrupt;
+    for(uint64_t s = 0; s < symbolCount; ++s)
+    {
+        string symbol;
+        if(!reader.getString(symbol) || (loaded.symbols.intern(symbol) != s))
+            return SnapshotStatus::corrupt;
+        loaded.tables.emplace_back();
+        auto& table = loaded.tables.edit(loaded.tables.size() - 1);
+        if(!snapshot::getTable(reader, fieldCount, table))
+            return SnapshotStatus::corrupt;
+        table.index.update(table.timestamps);
+    }
+    if(!reader.atEnd())
+        return SnapshotStatus::corrupt;
+    swap(tick, loaded);
+    return SnapshotStatus::ok;
+}
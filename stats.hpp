@@ -0,0 +1,227 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <iomanip>
+#include <cstdint>
+
+/* Hot path instrumentation - build with -DGS_NO_STATS and all of it folds away.
+ * Ingest phases are timed on one line out of SAMPLE_EVERY and extrapolated over the rest, two clock reads per token on every
+ * line would cost more than the parsing itself. Page faults of a mapped file land in whichever phase touches the page first,
+ * mostly tokenize. Query latencies go into log2 histograms of nanoseconds, safe to record from concurrent queries.
+ */
+#ifdef GS_NO_STATS
+constexpr bool STATS_ENABLED = false;
+#else
+constexpr bool STATS_ENABLED = true;
+#endif
+
+enum class Phase : unsigned
+{
+    read,
+    tokenize,
+    numberParse,
+    tableInsert,
+    sort                                                                        //out of order rows put back in time order, measured in full
+};
+constexpr unsigned PHASE_COUNT = 5u;
+
+inline uint64_t nowNs()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+struct IngestCounters                                                           //what one reader went through, phases in (estimated) ns
+{
+    uint64_t bytes{0};
+    uint64_t rows{0};
+    uint64_t sortedSymbols{0};                                                  //symbols that came in out of time order...
+    uint64_t sortedRows{0};                                                     //...and the rows that had to move
+    uint64_t phaseNs[PHASE_COUNT]{};
+    IngestCounters& operator+=(const IngestCounters& other)
+    {
+        bytes += other.bytes;
+        rows += other.rows;
+        sortedSymbols += other.sortedSymbols;
+        sortedRows += other.sortedRows;
+        for(auto phase = 0u; phase < PHASE_COUNT; ++phase)
+            phaseNs[phase] += other.phaseNs[phase];
+        return *this;
+    }
+};
+
+class PhaseTimer                                                                //laps over one line, a null target makes every lap a no-op
+{
+public:
+    explicit PhaseTimer(uint64_t* target) : phaseNs(STATS_ENABLED ? target : nullptr), last(phaseNs ? nowNs() : 0u){};
+    void lap(Phase phase)
+    {
+        if(STATS_ENABLED && phaseNs)
+        {
+            auto now = nowNs();
+            phaseNs[static_cast<unsigned>(phase)] += now - last;
+            last = now;
+        }
+    }
+private:
+    uint64_t* phaseNs;
+    uint64_t last;
+};
+
+class LatencyHistogram                                                          //bucket b - latencies in [2^b, 2^(b+1)) ns
+{
+public:
+    static constexpr unsigned BUCKETS = 64u;
+    void record(uint64_t ns)
+    {
+        buckets[ns ? 63 - __builtin_clzll(ns) : 0].fetch_add(1u, std::memory_order_relaxed);
+        count.fetch_add(1u, std::memory_order_relaxed);
+        totalNs.fetch_add(ns, std::memory_order_relaxed);
+        auto seen = maxNs.load(std::memory_order_relaxed);
+        while((seen < ns) && !maxNs.compare_exchange_weak(seen, ns, std::memory_order_relaxed))
+            ;
+    }
+    void reset()
+    {
+        for(auto& bucket : buckets)
+            bucket = 0u;
+        count = 0u;
+        totalNs = 0u;
+        maxNs = 0u;
+    }
+    void copyFrom(const LatencyHistogram& other)                               //not atomic as a whole - a call recorded meanwhile may be half in
+    {
+        for(auto bucket = 0u; bucket < BUCKETS; ++bucket)
+            buckets[bucket] = other.buckets[bucket].load();
+        count = other.count.load();
+        totalNs = other.totalNs.load();
+        maxNs = other.maxNs.load();
+    }
+    void dump(std::ostream& out, const char* name) const                        //percentiles are bucket upper bounds - good to a factor of 2
+    {
+        auto calls = count.load();
+        out << name << ": " << calls << " calls";
+        if(calls)
+        {
+            out << std::fixed << std::setprecision(3) << ", mean " << totalNs.load() / 1e3 / calls << " us";
+            for(auto percentile : {50u, 90u, 99u})
+                out << ", p" << percentile << " <= " << upperBoundNs(calls * percentile) / 1e3 << " us";
+            out << ", max " << maxNs.load() / 1e3 << " us";
+        }
+        out << "\n";
+    }
+private:
+    uint64_t upperBoundNs(uint64_t rank) const                                  //rank in hundredths of a call
+    {
+        uint64_t seen{0};
+        for(auto bucket = 0u; bucket < BUCKETS; ++bucket)
+        {
+            seen += buckets[bucket].load() * 100u;
+            if(seen >= rank)
+                return bucket < 63 ? uint64_t{2} << bucket : ~uint64_t{0};
+        }
+        return maxNs.load();
+    }
+
+    std::atomic<uint64_t> buckets[BUCKETS]{};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> totalNs{0};
+    std::atomic<uint64_t> maxNs{0};
+};
+
+class ScopedLatency
+{
+public:
+    explicit ScopedLatency(LatencyHistogram& target) : histogram(target), start(STATS_ENABLED ? nowNs() : 0u){};
+    ~ScopedLatency()
+    {
+        if(STATS_ENABLED)
+            histogram.record(nowNs() - start);
+    }
+private:
+    LatencyHistogram& histogram;
+    uint64_t start;
+};
+
+class Stats                                                                     //everything the `stats` command shows
+{
+public:
+    static constexpr unsigned SAMPLE_EVERY = 64u;                               //1 in 64 lines gets its phases timed
+    void addIngest(const IngestCounters& counters)
+    {
+        std::lock_guard<std::mutex> lock(guard);
+        ingest += counters;
+    }
+    void setSizes(size_t symbolCount, size_t fieldCount)
+    {
+        std::lock_guard<std::mutex> lock(guard);
+        symbols = symbolCount;
+        fields = fieldCount;
+    }
+    void reset()
+    {
+        std::lock_guard<std::mutex> lock(guard);
+        ingest = IngestCounters{};
+        print.reset();
+        product.reset();
+        aggregate.reset();
+        pageInFailures = 0;
+    }
+    void copyFrom(const Stats& other)                                           //a server version carries on the counts of the one it was made from
+    {
+        IngestCounters otherIngest{};
+        size_t otherSymbols{0}, otherFields{0};
+        {
+            std::lock_guard<std::mutex> lock(other.guard);
+            otherIngest = other.ingest;
+            otherSymbols = other.symbols;
+            otherFields = other.fields;
+        }
+        {
+            std::lock_guard<std::mutex> lock(guard);
+            ingest = otherIngest;
+            symbols = otherSymbols;
+            fields = otherFields;
+        }
+        print.copyFrom(other.print);
+        product.copyFrom(other.product);
+        aggregate.copyFrom(other.aggregate);
+        pageInFailures = other.pageInFailures.load();
+    }
+    void dump(std::ostream& out) const
+    {
+        if(!STATS_ENABLED)
+        {
+            out << "stats compiled out (GS_NO_STATS)\n";
+            return;
+        }
+        std::lock_guard<std::mutex> lock(guard);
+        static const char* NAMES[PHASE_COUNT] = {"read", "tokenize", "number parse", "table insert", "sort"};
+        out << "ingest: " << ingest.bytes << " bytes, " << ingest.rows << " rows, " << symbols << " symbols, " << fields << " fields\n"
+            << "ingest phases [ms, summed over threads]:";
+        for(auto phase = 0u; phase < PHASE_COUNT; ++phase)
+            out << (phase ? ", " : " ") << NAMES[phase] << " " << std::fixed << std::setprecision(3) << ingest.phaseNs[phase] / 1e6;
+        out << "\n" << "ingest out of order: " << ingest.sortedSymbols << " symbols sorted, " << ingest.sortedRows << " rows moved\n";
+        print.dump(out, "print");
+        product.dump(out, "product");
+        aggregate.dump(out, "agg");
+        if(pageInFailures)
+            out << "paging: " << pageInFailures << " spilled tables could not be read back\n";
+    }
+    IngestCounters ingestTotals() const
+    {
+        std::lock_guard<std::mutex> lock(guard);
+        return ingest;
+    }
+
+    LatencyHistogram print;
+    LatencyHistogram product;
+    LatencyHistogram aggregate;
+    std::atomic<uint64_t> pageInFailures{0};                                    //queries & snapshots that had to leave a spilled symbol out
+private:
+    mutable std::mutex guard;
+    IngestCounters ingest{};
+    size_t symbols{0};
+    size_t fields{0};
+};
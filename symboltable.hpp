@@ -0,0 +1,187 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <utility>
+#include <cmath>
+#include <cstdint>
+#include <time.h>
+#include "interner.hpp"
+#include "cowvector.hpp"
+
+using namespace std;
+using Range = pair<unsigned, unsigned>;                                        //[first, last) rows of a symbol table
+
+struct Column                                                                   //all the values of one field of one symbol, missing cells are NaN padding with their bit cleared
+{
+    vector<double> values;
+    vector<uint64_t> present;                                                   //bit r set - row r carries the field, a nan from the input too; always (values.size()+63)/64 words
+    bool has(size_t row) const
+    {
+        return (row < values.size()) && ((present[row >> 6] >> (row & 63)) & 1u);
+    }
+    void set(size_t row, double value)
+    {
+        if(row >= values.size())                                                //the column only grows as far as the last row that had the field
+        {
+            values.resize(row + 1, NAN);
+            present.resize((row >> 6) + 1, 0u);
+        }
+        values[row] = value;
+        present[row >> 6] |= uint64_t{1} << (row & 63);
+    }
+    void reserve(size_t rows)
+    {
+        values.reserve(rows);
+        present.reserve((rows + 63) >> 6);
+    }
+    void appendAt(size_t offset, const Column& other)                           //places other's rows starting at row 'offset', offset >= values.size()
+    {
+        if(other.values.empty())
+            return;
+        values.resize(offset, NAN);
+        values.insert(values.end(), other.values.begin(), other.values.end());
+        present.resize((values.size() + 63) >> 6, 0u);
+        auto word = offset >> 6;
+        auto shift = offset & 63;
+        for(auto i = 0u; i < other.present.size(); ++i)
+        {
+            present[word + i] |= other.present[i] << shift;
+            if(shift && (word + i + 1 < present.size()))
+                present[word + i + 1] |= other.present[i] >> (64 - shift);
+        }
+    }
+};
+
+struct TimeIndex                                                                //coarse block directory over a symbol's timestamps
+{
+    static constexpr size_t BLOCK = 1024u;                                      //rows per block - the directory of a 500M row symbol still fits in L2
+    vector<time_t> blockMin;
+    vector<time_t> blockMax;
+    size_t rows{0};                                                             //rows covered so far
+    bool sorted{true};
+    void update(const vector<time_t>& times)                                    //extends the directory over rows appended since the last call
+    {
+        if(times.size() < rows)                                                 //table was rebuilt underneath - start over
+            *this = TimeIndex{};
+        for(auto block = rows / BLOCK; block * BLOCK < times.size(); ++block)
+        {
+            auto first = block * BLOCK;
+            auto last = min(first + BLOCK, times.size());
+            auto minTime = times[first], maxTime = times[first];
+            for(auto row = first + 1; row < last; ++row)
+            {
+                sorted = sorted && (times[row-1] <= times[row]);
+                minTime = min(minTime, times[row]);
+                maxTime = max(maxTime, times[row]);
+            }
+            if(block < blockMin.size())                                         //the trailing block was partial last time around
+            {
+                blockMin[block] = minTime;
+                blockMax[block] = maxTime;
+            }
+            else
+            {
+                blockMin.push_back(minTime);
+                blockMax.push_back(maxTime);
+            }
+            if(block > 0)
+                sorted = sorted && (blockMax[block-1] <= minTime);
+        }
+        rows = times.size();
+    }
+    size_t firstNotBefore(const vector<time_t>& times, time_t time, size_t from) const  //first row >= time at or after 'from', times.size() if none
+    {
+        auto block = from / BLOCK;
+        if(sorted)                                                              //binary search over the directory, then within one block
+        {
+            auto blockIt = lower_bound(blockMax.begin() + min(block, blockMax.size()), blockMax.end(), time);
+            if(blockIt == blockMax.end())
+                return times.size();
+            auto first = max(from, static_cast<size_t>(distance(blockMax.begin(), blockIt)) * BLOCK);
+            auto last = min(first - first % BLOCK + BLOCK, times.size());
+            return distance(times.begin(), lower_bound(times.begin() + first, times.begin() + last, time));
+        }
+        for(; block < blockMax.size(); ++block)                                 //out of order data - still a scan, but blocks that can't match are skipped whole
+        {
+            if(blockMax[block] < time)
+                continue;
+            auto first = max(from, block * BLOCK);
+            auto last = min((block + 1) * BLOCK, times.size());
+            auto rowIt = find_if(times.begin() + first, times.begin() + last, [&](auto& a){return a >= time;});
+            if(rowIt != times.begin() + last)
+                return distance(times.begin(), rowIt);
+        }
+        return times.size();
+    }
+};
+
+struct SymbolTable                                                              //stored transposed - [M x N] - one dense column per field, see the desc in parser.hpp
+{
+    vector<time_t> timestamps;
+    vector<Column> columns;                                                     //indexed by field idx, fields the symbol never had may be absent
+    TimeIndex index;                                                            //kept up to date by whoever appends rows
+    size_t size() const { return timestamps.size(); }
+    void set(size_t row, unsigned field, double value)
+    {
+        if(field >= columns.size())
+            columns.resize(field + 1);
+        columns[field].set(row, value);
+    }
+    const Column* column(unsigned field) const
+    {
+        return field < columns.size() ? &columns[field] : nullptr;
+    }
+    void append(const SymbolTable& rows)                                        //rows behind the ones here, same field ids
+    {
+        auto offset = size();
+        timestamps.insert(timestamps.end(), rows.timestamps.begin(), rows.timestamps.end());
+        if(rows.columns.size() > columns.size())
+            columns.resize(rows.columns.size());
+        for(auto field = 0u; field < rows.columns.size(); ++field)
+            columns[field].appendAt(offset, rows.columns[field]);
+    }
+    size_t sortByTime(size_t inOrder)                                           //stable, rows [0, inOrder) are known to be in order - returns rows moved
+    {
+        auto first = timestamps.begin();
+        auto mid = static_cast<size_t>(distance(first, is_sorted_until(first + (inOrder ? inOrder - 1 : 0), timestamps.end())));
+        if(mid == size())                                                       //in order - nothing to do
+            return 0;
+        auto late = *min_element(first + mid, timestamps.end());
+        auto lo = static_cast<size_t>(distance(first, upper_bound(first, first + mid, late)));    //rows before lo stay where they are
+        vector<size_t> order(size() - lo);                                      //order[i] - the row that ends up at lo + i
+        iota(order.begin(), order.end(), lo);
+        auto byTime = [&](size_t a, size_t b){ return timestamps[a] < timestamps[b]; };
+        stable_sort(order.begin() + (mid - lo), order.end(), byTime);
+        inplace_merge(order.begin(), order.begin() + (mid - lo), order.end(), byTime);    //ties - the earlier run goes first, so stable overall
+        vector<time_t> times(order.size());
+        for(auto i = 0u; i < order.size(); ++i)
+            times[i] = timestamps[order[i]];
+        copy(times.begin(), times.end(), first + lo);
+        for(auto& column : columns)
+        {
+            if(column.values.size() <= lo)                                      //nothing of it gets moved
+                continue;
+            Column sorted{};
+            sorted.values.assign(column.values.begin(), column.values.begin() + min(lo, column.values.size()));
+            sorted.present.assign(column.present.begin(), column.present.begin() + ((sorted.values.size() + 63) >> 6));
+            if(sorted.values.size() & 63)
+                sorted.present.back() &= ~(~uint64_t{0} << (sorted.values.size() & 63));
+            for(auto i = 0u; i < order.size(); ++i)
+                if(column.has(order[i]))
+                    sorted.set(lo + i, column.values[order[i]]);
+            column = move(sorted);
+        }
+        index = TimeIndex{};
+        index.update(timestamps);
+        return order.size();
+    }
+};
+
+struct TickData                                                                 //everything a tick file boils down to
+{
+    Interner fields;                                                            //field name <-> column index, in order of first appearance
+    Interner symbols;                                                           //symbol name <-> index into tables
+    CowVector<SymbolTable> tables;                                              //a copy shares the tables, edit() before changing one
+};
@@ -1,17 +1,76 @@
 #include <gtest/gtest.h>
 #include "parser.hpp"
+#include "batch.hpp"
+#include "tickgen.hpp"
+#include "server.hpp"
+#include "schema.hpp"
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <stdio.h>
 #include <random>
+#include <numeric>
 #include <chrono>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
+#include <sys/stat.h>
+#include <sys/resource.h>
 
 using namespace std;
 using namespace testing;
 
 const time_t T_STAMP{1570289783};
 
+GS_SCHEMA_FIELD(F0, "f0");
+GS_SCHEMA_FIELD(F1, "f1");
+GS_SCHEMA_FIELD(F2, "f2");
+GS_SCHEMA_FIELD(F3, "f3");
+GS_SCHEMA_FIELD(F4, "f4");
+GS_SCHEMA_FIELD(F5, "f5");
+GS_SCHEMA_FIELD(F6, "f6");
+GS_SCHEMA_FIELD(F7, "f7");
+GS_SCHEMA_FIELD(F8, "f8");
+GS_SCHEMA_FIELD(F9, "f9");
+using TickGenSchema = FieldSchema<F0, F1, F2, F3, F4, F5, F6, F7, F8, F9>;      //what generateTicks writes
+
+atomic<size_t> allocationCount{0};                                              //every operator new of the test binary - lets the tests see what ingest costs
+
+__attribute__((noinline)) void* operator new(size_t size)                       //out of line - keeps gcc from pairing the malloc/free inside with new/delete
+{
+    ++allocationCount;
+    if(auto ptr = malloc(size ? size : 1))
+        return ptr;
+    throw bad_alloc{};
+}
+__attribute__((noinline)) void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+void operator delete(void* ptr, size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+long peakRssKiB()
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+void expectSameProducts(const string& expected, const string& actual)         //summation orders differ - relative bound plus one printed digit for a rounding tie
+{
+    stringstream expectedStr(expected), actualStr(actual);
+    double expectedVal, actualVal;
+    while(expectedStr >> expectedVal)
+    {
+        ASSERT_TRUE(actualStr >> actualVal);
+        EXPECT_NEAR(expectedVal, actualVal, fabs(expectedVal)*1e-12 + 1.001e-3);
+    }
+    EXPECT_FALSE(actualStr >> actualVal);
+}
+
 class IParserTestSuite
 {
     virtual void writeInData(size_t) = 0;
@@ -72,6 +131,213 @@ TEST_F(GenericParserTestSuite, returnsTrueWhilstOpeningEmptyFile)
     ASSERT_TRUE(sut.openTickFile("herpDerp.dat"));
 }
 
+TEST_F(GenericParserTestSuite, readsLastLineWithoutTrailingNewlineAndCarriageReturns)
+{
+    outFile = ofstream(fileName, ios::out | ios::trunc);
+    outFile << T_STAMP << ",s1,f1,6,f2,9\r\n" << T_STAMP+10 << ",s1,f1,7,f2,10";
+    outFile.close();
+    Parser sut{};
+    ASSERT_TRUE(sut.openTickFile(fileName));
+    testing::internal::CaptureStdout();
+    sut.print(T_STAMP-1, T_STAMP+11, "s1");
+    EXPECT_EQ("f1:6.000,f2:9.000\nf1:7.000,f2:10.000\n", testing::internal::GetCapturedStdout());
+}
+
+TEST_F(GenericParserTestSuite, fallsBackToStreamReadingForPipes)
+{
+    string pipeName{"herpDerp.fifo"};
+    ASSERT_EQ(0, mkfifo(pipeName.c_str(), 0600));
+    thread writer([&](){
+        ofstream pipe(pipeName, ios::out);
+        pipe << T_STAMP << ",s1,f1,6,f2,9\n" << T_STAMP+10 << ",s1,f1,7,f2,10\n";
+    });
+    Parser sut{};
+    EXPECT_TRUE(sut.openTickFile(pipeName));
+    writer.join();
+    remove(pipeName.c_str());
+    testing::internal::CaptureStdout();
+    sut.product(T_STAMP-1, T_STAMP+11, "s1", "f1", "f2");
+    EXPECT_EQ("124.000\n", testing::internal::GetCapturedStdout());
+}
+
+TEST_F(GenericParserTestSuite, duplicateTimestampsKeepInclusiveStartExclusiveEnd)
+{
+    outFile = ofstream(fileName, ios::out | ios::trunc);
+    outFile << T_STAMP    << ",s1,f1,1\n" << T_STAMP    << ",s1,f1,2\n"
+            << T_STAMP+10 << ",s1,f1,3\n" << T_STAMP+10 << ",s1,f1,4\n" << T_STAMP+20 << ",s1,f1,5\n";
+    outFile.close();
+    Parser sut{};
+    ASSERT_TRUE(sut.openTickFile(fileName));
+    testing::internal::CaptureStdout();
+    sut.print(T_STAMP, T_STAMP+10, "s1");
+    sut.print(T_STAMP+10, T_STAMP+20, "s1");
+    sut.product(T_STAMP+1, T_STAMP+11, "s1", "f1", "f1");
+    EXPECT_EQ("f1:1.000\nf1:2.000\nf1:3.000\nf1:4.000\n25.000\n", testing::internal::GetCapturedStdout());
+}
+
+struct TimeIndexParam
+{
+    bool sorted;
+    size_t rows;
+};
+
+struct TimeIndexParamTestSuite : Test, WithParamInterface<TimeIndexParam>
+{};
+
+INSTANTIATE_TEST_CASE_P(TimeIndexTest, TimeIndexParamTestSuite,
+                        Values(TimeIndexParam{true, 1},
+                               TimeIndexParam{true, TimeIndex::BLOCK},
+                               TimeIndexParam{true, TimeIndex::BLOCK*5 + 17},
+                               TimeIndexParam{false, TimeIndex::BLOCK*5 + 17}));
+
+TEST_P(TimeIndexParamTestSuite, matchesLinearSearch)
+{
+    auto param = GetParam();
+    mt19937 engine(42);
+    uniform_int_distribution<int> step(param.sorted ? 0 : -3, 3);               //plenty of duplicates either way
+    vector<time_t> times{T_STAMP};
+    while(times.size() < param.rows)
+        times.push_back(times.back() + step(engine));
+
+    TimeIndex sut{};
+    sut.update(vector<time_t>(times.begin(), times.begin() + times.size() / 2));    //incremental update over a partial block
+    sut.update(times);
+    EXPECT_EQ(param.sorted, sut.sorted);
+    uniform_int_distribution<size_t> from(0, times.size());
+    for(auto probe = times.front() - 2; probe <= times.back() + 2; ++probe)
+    {
+        auto start = from(engine);
+        auto expected = distance(times.begin(), find_if(times.begin() + start, times.end(), [&](auto& a){return a >= probe;}));
+        ASSERT_EQ(static_cast<size_t>(expected), sut.firstNotBefore(times, probe, start)) << "probe " << probe << " from " << start;
+    }
+}
+
+TEST_P(TimeIndexParamTestSuite, sortByTimeIsStable)
+{
+    auto param = GetParam();
+    mt19937 engine(5);
+    uniform_int_distribution<int> step(param.sorted ? 0 : -3, 3);
+    vector<pair<time_t, double>> rows;
+    SymbolTable sut{};
+    size_t moved{0};
+    for(auto half = 0u; half < 2; ++half)                                       //the second half goes in after the first got sorted
+    {
+        auto inOrder = sut.size();
+        for(auto row = inOrder; row < param.rows * (half + 1) / 2 + half; ++row)
+        {
+            rows.push_back({(rows.empty() ? T_STAMP : rows.back().first) + step(engine), static_cast<double>(row)});
+            sut.timestamps.push_back(rows.back().first);
+            if(row % 3)                                                         //a gap now and then, values tell rows apart
+                sut.set(row, 1, row);
+        }
+        moved += sut.sortByTime(inOrder);
+    }
+    stable_sort(rows.begin(), rows.end(), [](const pair<time_t, double>& a, const pair<time_t, double>& b){ return a.first < b.first; });
+    EXPECT_EQ(param.sorted, moved == 0);
+    EXPECT_TRUE(sut.index.sorted);
+    ASSERT_EQ(rows.size(), sut.size());
+    for(auto row = 0u; row < rows.size(); ++row)
+    {
+        ASSERT_EQ(rows[row].first, sut.timestamps[row]) << row;
+        ASSERT_EQ(static_cast<size_t>(rows[row].second) % 3 != 0, sut.columns[1].has(row)) << row;
+        if(sut.columns[1].has(row))
+        {
+            ASSERT_EQ(rows[row].second, sut.columns[1].values[row]) << row;
+        }
+    }
+    EXPECT_EQ(0u, sut.sortByTime(sut.size()));
+}
+
+TEST_P(TimeIndexParamTestSuite, packedTableMatchesRawTable)
+{
+    auto param = GetParam();
+    mt19937 engine(7);
+    uniform_int_distribution<int> step(param.sorted ? 0 : -3, 3);
+    uniform_int_distribution<int> coin(0, 2);
+    SymbolTable raw{};
+    for(auto row = 0u; row < param.rows; ++row)
+    {
+        raw.timestamps.push_back(row ? raw.timestamps.back() + step(engine) : T_STAMP);
+        if(coin(engine))
+            raw.set(row, 0, 20.0 + row % 7 * 0.125);                            //slowly changing - the XOR path with a reused window
+        if(coin(engine) == 2)
+            raw.set(row, 2, -1.0 / (row + 1));                                  //noisy mantissas - new windows
+    }
+    raw.index.update(raw.timestamps);
+    PackedTable sut{};
+    SymbolTable firstHalf{}, secondHalf{};                                      //appended in two goes - the partial tail block gets re-encoded
+    for(auto row = 0u; row < raw.size(); ++row)
+    {
+        auto& half = row < raw.size() / 2 ? firstHalf : secondHalf;
+        half.timestamps.push_back(raw.timestamps[row]);
+        for(auto field = 0u; field < raw.columns.size(); ++field)
+            if(raw.columns[field].has(row))
+                half.set(half.size() - 1, field, raw.columns[field].values[row]);
+    }
+    sut.append(firstHalf);
+    sut.append(secondHalf);
+    ASSERT_EQ(raw.size(), sut.size());
+    SymbolTable unpacked{};
+    sut.unpack(unpacked);
+    EXPECT_EQ(raw.timestamps, unpacked.timestamps);
+    for(auto field = 0u; field < raw.columns.size(); ++field)
+        for(auto row = 0u; row < raw.size(); ++row)
+        {
+            ASSERT_EQ(raw.columns[field].has(row), unpacked.columns[field].has(row)) << field << " " << row;
+            if(raw.columns[field].has(row))
+            {
+                ASSERT_EQ(raw.columns[field].values[row], unpacked.columns[field].values[row]) << field << " " << row;
+            }
+        }
+    auto rawRange = [&](time_t startTime, time_t endTime){                      //what Parser::findRange makes of the raw rows
+        const auto& times = raw.timestamps;
+        auto rangeBeg = (startTime < times[0] ? 0u : raw.index.firstNotBefore(times, startTime, 0u));
+        auto rangeEnd = (endTime > times.back() ? times.size() : raw.index.firstNotBefore(times, endTime, rangeBeg));
+        if((rangeBeg == times.size()) || (rangeBeg >= rangeEnd))
+            return ::Range{0, 0};
+        return ::Range{static_cast<unsigned>(rangeBeg), static_cast<unsigned>(rangeEnd)};
+    };
+    uniform_int_distribution<int> span(0, 40);
+    for(auto probe = raw.timestamps.front() - 2; probe <= raw.timestamps.back() + 2; ++probe)
+    {
+        auto end = probe + span(engine);
+        ASSERT_EQ(rawRange(probe, end), sut.findRange(probe, end)) << "probe " << probe;
+    }
+}
+
+TEST_F(GenericParserTestSuite, followPicksUpOnlyAppendedCompleteLines)
+{
+    Parser sut{};
+    ASSERT_TRUE(sut.openTickFile(fileName));
+    outFile = ofstream(fileName, ios::out | ios::app);
+    outFile << T_STAMP+30 << ",s1,f1,1,f5,2\n" << T_STAMP+40 << ",s3,f5,3";     //the second line is still being written
+    outFile.flush();
+    ASSERT_TRUE(sut.followTickFile(fileName));
+    testing::internal::CaptureStdout();
+    sut.print(T_STAMP+5, T_STAMP+50, "s1");
+    sut.print(T_STAMP+5, T_STAMP+50, "s3");
+    EXPECT_EQ("f1:7.000,f2:10.000,f3:13.000,f4:11.000\nf1:1.000,f5:2.000\n", testing::internal::GetCapturedStdout());
+
+    outFile << ",f1,4\n";
+    outFile.close();
+    ASSERT_TRUE(sut.followTickFile(fileName));
+    ASSERT_TRUE(sut.followTickFile(fileName));                                  //nothing new - nothing happens
+    testing::internal::CaptureStdout();
+    sut.print(T_STAMP+5, T_STAMP+50, "s3");
+    sut.product(T_STAMP-1, T_STAMP+50, "s1", "f1", "f2");
+    EXPECT_EQ("f1:4.000,f5:3.000\n124.000\n", testing::internal::GetCapturedStdout());
+}
+
+TEST_F(GenericParserTestSuite, followOfUnseenFileReadsItFromTheTop)
+{
+    Parser sut{};
+    EXPECT_FALSE(sut.followTickFile("herpderp"));
+    ASSERT_TRUE(sut.followTickFile(fileName));
+    testing::internal::CaptureStdout();
+    sut.product(T_STAMP-1, T_STAMP+21, "s1", "f1", "f2");
+    EXPECT_EQ("124.000\n", testing::internal::GetCapturedStdout());
+}
+
 struct ProductParam
 {
     time_t rangeStart;
@@ -93,7 +359,8 @@ INSTANTIATE_TEST_CASE_P(ProductTest, SmallFileParserProductParamTestSuite,
                               ProductParam{T_STAMP-1, T_STAMP+1, "s2", "f1", "f4", ""},
                               ProductParam{T_STAMP+1, T_STAMP+2, "s1", "f1", "f2", ""},
                               ProductParam{T_STAMP-1, T_STAMP+11,"s1", "f1", "f2", "124.000\n"},
-                              ProductParam{T_STAMP-1, T_STAMP+21,"s1", "f1", "f2", "124.000\n"}));
+                              ProductParam{T_STAMP-1, T_STAMP+21,"s1", "f1", "f2", "124.000\n"},
+                              ProductParam{T_STAMP-1, T_STAMP+21,"s1", "f1", "f5", "0.000\n"}));
 
 TEST_P(SmallFileParserProductParamTestSuite, expectSpecificProduct)
 {
@@ -105,6 +372,48 @@ TEST_P(SmallFileParserProductParamTestSuite, expectSpecificProduct)
     EXPECT_EQ(param.expectation, testing::internal::GetCapturedStdout());
 }
 
+TEST_P(SmallFileParserProductParamTestSuite, expectSpecificProductFromProductParser)
+{
+    ProductParser sut{};
+    sut.setProductThreads(2);
+    sut.openTickFile("herpDerp.dat");
+    auto param = GetParam();
+    testing::internal::CaptureStdout();
+    sut.product(param.rangeStart, param.rangeEnd, param.symbol, param.field1, param.field2);
+    EXPECT_EQ(param.expectation, testing::internal::GetCapturedStdout());
+}
+
+TEST(MaskedDotKernelTestSuite, everyKernelMatchesTheScalarOne)
+{
+    mt19937 engine(7);
+    normal_distribution<> value(15.0, 5.0);
+    bernoulli_distribution missing(0.3);
+    vector<double> a(1027), b(1027);
+    vector<uint64_t> presentA(17, ~uint64_t{0}), presentB(17, ~uint64_t{0});
+    for(auto i = 0u; i < a.size(); ++i)
+    {
+        a[i] = value(engine);
+        b[i] = value(engine);
+        if((i >= 512) && missing(engine))                                       //dense first half, sparse second
+            presentB[i >> 6] &= ~(uint64_t{1} << (i & 63));
+    }
+    vector<DenseDotKernel> kernels{selectDenseDot()};
+#ifdef GS_X86_KERNELS
+    kernels.push_back(denseDotSse2);
+#endif
+    for(auto kernel : kernels)
+        for(auto count : {0u, 1u, 7u, 8u, 1027u})
+            EXPECT_NEAR(denseDotScalar(a.data(), b.data(), count), kernel(a.data(), b.data(), count), 1e-9);
+    for(auto range : {make_pair(0u, 1027u), make_pair(3u, 700u), make_pair(64u, 128u), make_pair(600u, 601u)})
+    {
+        double expected{0};
+        for(auto i = range.first; i < range.second; ++i)
+            if((presentB[i >> 6] >> (i & 63)) & 1u)
+                expected += a[i]*b[i];
+        EXPECT_NEAR(expected, maskedDot(a.data(), b.data(), presentA.data(), presentB.data(), range.first, range.second), 1e-9);
+    }
+}
+
 struct PrintParam
 {
     time_t rangeStart;
@@ -134,6 +443,198 @@ TEST_P(SmallFileParserPrintParamTestSuite, expectSpecificPrint)
     EXPECT_EQ(param.expectation, testing::internal::GetCapturedStdout());
 }
 
+TEST_P(SmallFileParserPrintParamTestSuite, expectSpecificPrintFromPrintParser)
+{
+    PrintParser sut{};
+    sut.setPrintThreads(2);
+    sut.openTickFile("herpDerp.dat");
+    auto param = GetParam();
+    testing::internal::CaptureStdout();
+    sut.print(param.rangeStart, param.rangeEnd, param.symbol);
+    EXPECT_EQ(param.expectation, testing::internal::GetCapturedStdout());
+}
+
+TEST(Fixed3FormatterTestSuite, matchesIostreamFormatting)
+{
+    mt19937_64 engine(11);
+    vector<double> values{0.0, -0.0, 0.0005, 1.0005, 2.0015, -0.0004, -1.2345, 0.1235, 999.9995, 1e12, -3e15, 1e300, 5e-324, INFINITY, -INFINITY};
+    uniform_real_distribution<> wide(-1e6, 1e6);
+    uniform_int_distribution<int> millis(-2000000, 2000000);
+    for(auto i = 0; i < 20000; ++i)
+    {
+        values.push_back(wide(engine));
+        values.push_back(millis(engine) / 1000.0 + 0.0005);                     //right on the rounding edge
+        values.push_back(millis(engine) / 1000.0);
+    }
+    for(auto value : values)
+    {
+        stringstream expected;
+        expected << std::fixed << std::setprecision(3) << value;
+        string actual;
+        appendFixed3(actual, value);
+        ASSERT_EQ(expected.str(), actual) << std::setprecision(17) << value;
+    }
+}
+
+TEST(NumberParserTestSuite, decimalsMatchStrtodBitForBit)
+{
+    mt19937_64 engine(13);
+    vector<string> tokens{"0", "-0", "+7", "0.0", ".5", "5.", "-.25", "007.500", "123456789012345", "1234567890123456",
+                          "0.1", "0.3", "9007199254740993", "1e10", "-2.5E-3", "inf", "nan", "12abc", "", "-", ".", " 4.2",
+                          "0.00000000000000000000001", "999999999999999.9", "1.7976931348623157e308", "4.9e-324",
+                          "1" + string(70, '0'), "0." + string(63, '0') + "1", "-" + string(80, '9') + ".5e-20"};   //past MAX_TOKEN
+    uniform_int_distribution<int64_t> mantissas(-999999999999999, 999999999999999);
+    uniform_int_distribution<int> scales(0, 25);
+    for(auto i = 0; i < 50000; ++i)
+    {
+        auto digits = to_string(mantissas(engine));
+        auto scale = scales(engine);
+        auto sign = digits[0] == '-' ? 1u : 0u;
+        while(digits.size() - sign <= static_cast<size_t>(scale))
+            digits.insert(sign, "0");
+        digits.insert(digits.size() - scale, ".");
+        tokens.push_back(digits);
+    }
+    for(const auto& token : tokens)
+    {
+        auto expected = strtod(token.c_str(), nullptr);
+        auto actual = numparse::parseDecimal(token.data(), token.size());
+        ASSERT_EQ(0, memcmp(&expected, &actual, sizeof(double))) << token;     //also tells -0.0 from 0.0 and compares nan bits
+    }
+}
+
+TEST(NumberParserTestSuite, timestampsKeepAll64Bits)
+{
+    for(const auto& token : {"0", "1570289783", "4102444800", "-86400", "922337203685477580", "9223372036854775807",
+                             "-9223372036854775808", "123x", "", " 42",
+                             "0000000000000000000000000000000000000000000000000000000000000000001570289783"})
+        EXPECT_EQ(static_cast<time_t>(strtoll(token, nullptr, 10)), numparse::parseTime(token, strlen(token))) << token;
+}
+
+TEST_F(GenericParserTestSuite, statsCountIngestAndQueries)
+{
+    Parser sut{};
+    EXPECT_FALSE(sut.setRollups(true, {{"f1", "zz"}}));                         //unknown fields don't get counted below
+    ASSERT_TRUE(sut.openTickFile(fileName));
+    stringstream out;
+    sut.print(T_STAMP, T_STAMP+20, "s1", out);
+    sut.product(T_STAMP, T_STAMP+20, "s1", "f1", "f2", out);
+    sut.product(T_STAMP, T_STAMP+20, "s2", "f1", "f2", out);
+    stringstream stats;
+    sut.printStats(stats);
+    if(!STATS_ENABLED)
+        return;
+    EXPECT_NE(string::npos, stats.str().find("ingest: 108 bytes, 3 rows, 2 symbols, 4 fields\n")) << stats.str();
+    EXPECT_NE(string::npos, stats.str().find("print: 1 calls")) << stats.str();
+    EXPECT_NE(string::npos, stats.str().find("product: 2 calls")) << stats.str();
+    sut.resetStats();
+    stats.str("");
+    sut.printStats(stats);
+    EXPECT_NE(string::npos, stats.str().find("ingest: 0 bytes, 0 rows, 2 symbols, 4 fields\n")) << stats.str();
+}
+
+TEST_F(GenericParserTestSuite, timestampsPast2038AreNotTruncated)
+{
+    outFile = ofstream(fileName, ios::out | ios::trunc);
+    outFile << "4102444800,s1,f1,2.5,f2,4\n" << "4102444810,s1,f1,1.5,f2,2\n";
+    outFile.close();
+    Parser sut{};
+    ASSERT_TRUE(sut.openTickFile(fileName));
+    testing::internal::CaptureStdout();
+    sut.print(4102444800, 4102444801, "s1");
+    sut.product(4102444800, 4102444811, "s1", "f1", "f2");
+    EXPECT_EQ("f1:2.500,f2:4.000\n13.000\n", testing::internal::GetCapturedStdout());
+}
+
+TEST_F(GenericParserTestSuite, nanInInputIsNotAMissingField)
+{
+    outFile = ofstream(fileName, ios::out | ios::trunc);
+    outFile << T_STAMP << ",s1,f1,2,f2,3\n" << T_STAMP+1 << ",s1,f1,nan,f2,4\n" << T_STAMP+2 << ",s1,f2,5\n"
+            << T_STAMP+3 << ",s1,f1,1,f2,6\n";
+    outFile.close();
+    Parser parser{}, packed{};
+    ProductParser productParser{};
+    packed.setCompressedStorage(true);
+    for(auto sut : {&parser, &packed, static_cast<Parser*>(&productParser)})
+    {
+        ASSERT_TRUE(sut->openTickFile(fileName));
+        sut->setPrefixSumBudget(1u << 20);
+        stringstream out;
+        sut->print(T_STAMP, T_STAMP+3, "s1", out);
+        sut->product(T_STAMP, T_STAMP+4, "s1", "f1", "f2", out);              //the nan row counts
+        sut->product(T_STAMP+2, T_STAMP+4, "s1", "f1", "f2", out);            //the row without f1 doesn't
+        sut->product(T_STAMP, T_STAMP+1, "s1", "f1", "f2", out);
+        EXPECT_TRUE(sut->aggregate(T_STAMP, T_STAMP+4, "s1", "count", {"f1"}, out));
+        EXPECT_EQ("f1:2.000,f2:3.000\nf1:nan,f2:4.000\nf2:5.000\nnan\n6.000\n6.000\n3\n", out.str());
+    }
+}
+
+TEST_F(GenericParserTestSuite, schemaParserFallsBackOnLinesOffTheSchema)
+{
+    outFile = ofstream(fileName, ios::out | ios::trunc);
+    outFile << T_STAMP << ",s1,f3,1,f7,2\n"                                      //schema order, fields skipped
+            << T_STAMP+1 << ",s1,f7,3,f3,4\r\n"                                 //out of order
+            << T_STAMP+2 << ",s2,f1,5,g1,6\n"                                    //a field the schema doesn't know
+            << T_STAMP+3 << ",s1,f0,7,f0,8\n"                                    //repeated
+            << T_STAMP+4 << ",s2,f10,9,f2,10\n"                                  //a schema name's prefix isn't the name
+            << T_STAMP+5 << ",s1,f9\n"                                           //no value
+            << T_STAMP+6 << ",s2,f9,\n"
+            << T_STAMP+7 << ",s1\n";
+    outFile.close();
+    Parser reference{};
+    SchemaParser<TickGenSchema> sut{};
+    ASSERT_TRUE(reference.openTickFile(fileName));
+    ASSERT_TRUE(sut.openTickFile(fileName));
+    for(const auto& symbol : {"s1", "s2"})
+    {
+        stringstream expected, actual;
+        reference.print(T_STAMP, T_STAMP+10, symbol, expected);
+        sut.print(T_STAMP, T_STAMP+10, symbol, actual);
+        reference.product(T_STAMP, T_STAMP+10, symbol, "f3", "f7", expected);
+        sut.product(T_STAMP, T_STAMP+10, symbol, "f3", "f7", actual);
+        EXPECT_EQ(expected.str(), actual.str());
+    }
+    stringstream stats;
+    sut.printStats(stats);
+    EXPECT_NE(string::npos, stats.str().find(" bytes, 8 rows, 2 symbols, 8 fields\n")) << stats.str();
+}
+
+TEST_F(GenericParserTestSuite, aggregatesOverFieldExpressions)
+{
+    Parser sut{};
+    ASSERT_TRUE(sut.openTickFile(fileName));
+    stringstream out;
+    EXPECT_TRUE(sut.aggregate(T_STAMP, T_STAMP+20, "s1", "sum", {"f1*f2"}, out));
+    EXPECT_TRUE(sut.aggregate(T_STAMP, T_STAMP+20, "s1", "mean", {"f1"}, out));
+    EXPECT_TRUE(sut.aggregate(T_STAMP, T_STAMP+20, "s1", "min", {"f2"}, out));
+    EXPECT_TRUE(sut.aggregate(T_STAMP, T_STAMP+20, "s1", "max", {"f3"}, out));
+    EXPECT_TRUE(sut.aggregate(T_STAMP, T_STAMP+20, "s1", "count", {"f4"}, out));
+    EXPECT_TRUE(sut.aggregate(T_STAMP, T_STAMP+20, "s1", "variance", {"f1"}, out));
+    EXPECT_TRUE(sut.aggregate(T_STAMP, T_STAMP+20, "s1", "covariance", {"f1", "f2*f3"}, out));
+    EXPECT_TRUE(sut.aggregate(T_STAMP, T_STAMP+30, "s2", "variance", {"f1"}, out));    //one row - undefined
+    EXPECT_TRUE(sut.aggregate(T_STAMP, T_STAMP+20, "s1", "count", {"f9"}, out));
+    EXPECT_TRUE(sut.aggregate(T_STAMP+30, T_STAMP+40, "s1", "count", {"f1"}, out));    //no rows - nothing printed
+    EXPECT_EQ("124.000\n6.500\n9.000\n13.000\n2\n0.500\n11.000\nnan\n0\n", out.str());
+    EXPECT_FALSE(sut.aggregate(T_STAMP, T_STAMP+20, "s1", "median", {"f1"}, out));
+    EXPECT_FALSE(sut.aggregate(T_STAMP, T_STAMP+20, "s1", "covariance", {"f1"}, out));
+    EXPECT_FALSE(sut.aggregate(T_STAMP, T_STAMP+20, "s1", "sum", {"f1*"}, out));
+    EXPECT_FALSE(sut.aggregate(T_STAMP, T_STAMP+20, "s1", "sum", {"f1*f2*f3"}, out));
+}
+
+TEST_F(GenericParserTestSuite, symbolSetsFanOutInDeterministicOrder)
+{
+    Parser sut{};
+    ASSERT_TRUE(sut.openTickFile(fileName));
+    stringstream out;
+    sut.product(T_STAMP, T_STAMP+30, "*", "f1", "f2", true, out);
+    sut.product(T_STAMP, T_STAMP+30, "s2,s1,s2,s9", "f1", "f2", out);          //list order, no repeats, unknown names skipped
+    sut.product(T_STAMP, T_STAMP+30, "q*", "f1", "f2", true, out);
+    sut.print(T_STAMP+10, T_STAMP+30, "s*", out);
+    EXPECT_EQ("s1 124.000\ns2 40.000\ntotal 164.000\n"
+              "s2 40.000\ns1 124.000\n"
+              "s1:\nf1:7.000,f2:10.000,f3:13.000,f4:11.000\ns2:\nf1:5.000,f2:8.000,f3:11.000,f4:9.000\n", out.str());
+}
+
 struct PerfParam
 {
     size_t fileSize;        //in bytes
@@ -146,48 +647,1002 @@ struct PerfParam
 
 struct LargeFileWriterTestSuite : GenericParserTestSuite
 {
-    virtual void writeInData(size_t byteCount) override
+    virtual void writeInData(size_t byteCount) override                         //seeded - a failing run can be reproduced
+    {
+        TickGenConfig config{};
+        config.bytes = byteCount;
+        config.startTime = T_STAMP;
+        generateTicks(outFile, config);
+    }
+    void followInTwoHalves(Parser& target, const function<void()>& between = []{}) //file already generated - followed in two goes, the second half lands mid table
     {
-        const vector<string> symbolTable = {"s0","s1","s2","s3","s4","s5","s6","s7","s8","s9"};
-        const vector<string> fieldTable = {"f0","f1","f2","f3","f4","f5","f6","f7","f8","f9"};
-        random_device rDev;
-        default_random_engine randIntEngine(rDev());
-        mt19937 randValueEngine(rDev());
-        uniform_int_distribution<unsigned> randTime(0, 10);                      //time increments
-        uniform_int_distribution<unsigned> randSymbol(0, 9);
-        uniform_int_distribution<unsigned> randField(1, 1023);                   //the binary rep determines which field is present from the field table
+        string full;
+        {
+            ifstream in(fileName);
+            full.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+        }
+        auto half = full.find('\n', full.size() / 2) + 1;
+        ofstream(fileName, ios::out | ios::trunc) << full.substr(0, half);
+        ASSERT_TRUE(target.followTickFile(fileName));
+        between();
+        ofstream(fileName, ios::out | ios::app) << full.substr(half);
+        ASSERT_TRUE(target.followTickFile(fileName));
+    }
+};
 
-        normal_distribution<> randValue(15.0, 5.0);
+TEST(TickGeneratorTestSuite, sameSeedSameBytes)
+{
+    TickGenConfig config{};
+    config.bytes = 1u << 16;
+    stringstream first, second, third;
+    auto lines = generateTicks(first, config);
+    EXPECT_EQ(lines, generateTicks(second, config));
+    auto bytes = first.str();
+    EXPECT_EQ(bytes, second.str());
+    EXPECT_EQ(static_cast<size_t>(count(bytes.begin(), bytes.end(), '\n')), lines);
+    EXPECT_GE(bytes.size(), config.bytes);
+    config.seed = 2;
+    generateTicks(third, config);
+    EXPECT_NE(bytes, third.str());
+}
 
-        unsigned time=T_STAMP;
+TEST_F(LargeFileWriterTestSuite, parallelIngestMatchesSerialIngest)
+{
+    generateInputFile(1024*256);
+    Parser serial{}, parallel{};
+    serial.setIngestThreads(1);
+    parallel.setIngestThreads(7);
+    ASSERT_TRUE(serial.openTickFile(fileName));
+    ASSERT_TRUE(parallel.openTickFile(fileName));
+    for(const auto& symbol : {"s0", "s3", "s9"})
+    {
+        testing::internal::CaptureStdout();
+        serial.print(T_STAMP, T_STAMP*2, symbol);
+        serial.product(T_STAMP, T_STAMP*2, symbol, "f0", "f9");
+        auto expected = testing::internal::GetCapturedStdout();
+        testing::internal::CaptureStdout();
+        parallel.print(T_STAMP, T_STAMP*2, symbol);
+        parallel.product(T_STAMP, T_STAMP*2, symbol, "f0", "f9");
+        EXPECT_EQ(expected, testing::internal::GetCapturedStdout());
+    }
+}
 
-        auto generateLine = [&]() -> stringstream
+TEST_F(LargeFileWriterTestSuite, schemaParserMatchesGenericParser)
+{
+    generateInputFile(1024*256);
+    Parser reference{};
+    SchemaParser<TickGenSchema> serial{};
+    SchemaParser<TickGenSchema, PrintParser> parallel{};
+    serial.setIngestThreads(1);
+    parallel.setIngestThreads(5);
+    ASSERT_TRUE(reference.openTickFile(fileName));
+    ASSERT_TRUE(serial.openTickFile(fileName));
+    ASSERT_TRUE(parallel.openTickFile(fileName));
+    for(auto sut : {static_cast<Parser*>(&serial), static_cast<Parser*>(&parallel)})
+        for(const auto& symbol : {"s0", "s3", "s*"})
         {
-            stringstream out{};
-            time += randTime(randIntEngine);
-            out << time << "," << symbolTable[randSymbol(randIntEngine)];
-            for(auto i = randField(randIntEngine), bit = 0u; i > 0; i >>= 1, ++bit)
+            stringstream expected, actual;
+            reference.print(T_STAMP, T_STAMP*2, symbol, expected);
+            reference.product(T_STAMP, T_STAMP*2, symbol, "f0", "f9", expected);
+            sut->print(T_STAMP, T_STAMP*2, symbol, actual);
+            sut->product(T_STAMP, T_STAMP*2, symbol, "f0", "f9", actual);
+            EXPECT_EQ(expected.str(), actual.str());
+        }
+}
+
+TEST_F(LargeFileWriterTestSuite, compressedStorageGivesIdenticalResults)
+{
+    generateInputFile(1024*256);
+    Parser raw{};
+    ProductParser packed{};
+    packed.setCompressedStorage(true);
+    ASSERT_TRUE(raw.openTickFile(fileName));
+    followInTwoHalves(packed);                                                  //the compressed one gets it in two goes
+    EXPECT_LT(packed.storageBytes() * 2, raw.storageBytes());
+    for(const auto& symbol : {"s0", "s7"})
+    {
+        stringstream expected, actual;
+        raw.print(T_STAMP+500, T_STAMP+40000, symbol, expected);
+        packed.print(T_STAMP+500, T_STAMP+40000, symbol, actual);
+        EXPECT_EQ(expected.str(), actual.str());
+        expected.str("");
+        actual.str("");
+        raw.product(T_STAMP, T_STAMP*2, symbol, "f0", "f9", expected);
+        raw.product(T_STAMP+1234, T_STAMP+56789, symbol, "f3", "f3", expected);
+        packed.product(T_STAMP, T_STAMP*2, symbol, "f0", "f9", actual);
+        packed.product(T_STAMP+1234, T_STAMP+56789, symbol, "f3", "f3", actual);
+        expectSameProducts(expected.str(), actual.str());
+    }
+    packed.setCompressedStorage(false);                                         //and back to raw columns
+    stringstream expected, actual;
+    raw.print(T_STAMP, T_STAMP*2, "s3", expected);
+    packed.print(T_STAMP, T_STAMP*2, "s3", actual);
+    EXPECT_EQ(expected.str(), actual.str());
+}
+
+struct AggProbe : Parser
+{
+    using Parser::findTable;
+    using Parser::findRange;
+    const Column* column(const SymbolTable& table, const string& field) const
+    {
+        return table.column(tick.fields.find(field));
+    }
+};
+
+TEST_F(LargeFileWriterTestSuite, aggregatesMatchBruteForce)
+{
+    for(auto density : {1.0, 0.5})                                              //full bitmap words take the unrolled path, the rest go bit by bit
+    {
+        TickGenConfig config{};
+        config.bytes = 1024*256;
+        config.startTime = T_STAMP;
+        config.fieldDensity = density;
+        {
+            ofstream out(fileName, ios::out | ios::trunc);
+            generateTicks(out, config);
+        }
+        AggProbe raw{};
+        Parser packed{};
+        packed.setCompressedStorage(true);
+        ASSERT_TRUE(raw.openTickFile(fileName));
+        ASSERT_TRUE(packed.openTickFile(fileName));
+        auto table = raw.findTable("s3");
+        ASSERT_NE(nullptr, table);
+        auto f1 = raw.column(*table, "f1"), f2 = raw.column(*table, "f2"), f3 = raw.column(*table, "f3");
+        ASSERT_TRUE(f1 && f2 && f3);
+        mt19937 engine(5);
+        uniform_int_distribution<time_t> offset(0, 20000);
+        for(auto query = 0; query < 20; ++query)
+        {
+            auto start = T_STAMP + offset(engine);
+            auto end = start + offset(engine);
+            for(const auto& func : {"count", "mean", "min", "max", "variance", "sum"})
             {
-                if(i & 1)
+                stringstream rawOut, packedOut;
+                ASSERT_TRUE(raw.aggregate(start, end, "s3", func, {"f1"}, rawOut));
+                ASSERT_TRUE(packed.aggregate(start, end, "s3", func, {"f1"}, packedOut));
+                if(rawOut.str() != packedOut.str())                             //lanes fold per decoded block - the order of the additions differs
+                    expectSameProducts(rawOut.str(), packedOut.str());
+            }
+            auto range = raw.findRange(*table, start, end);
+            vector<double> x, y, z;
+            for(auto row = range.first; row < range.second; ++row)
+            {
+                if(f1->has(row))
+                    z.push_back(f1->values[row]);
+                if(f1->has(row) && f2->has(row) && f3->has(row))
                 {
-                    out << "," << fieldTable[bit] << "," << std::fixed << std::setprecision(3) << randValue(randValueEngine);
+                    x.push_back(f1->values[row]);
+                    y.push_back(f2->values[row] * f3->values[row]);
                 }
+            }
+            if(x.size() < 2)
+                continue;
+            auto mean = [](const vector<double>& v){ return accumulate(v.begin(), v.end(), 0.0) / v.size(); };
+            double covXY{0}, varZ{0};
+            for(auto i = 0u; i < x.size(); ++i)
+                covXY += (x[i] - mean(x)) * (y[i] - mean(y)) / (x.size() - 1);
+            for(auto value : z)
+                varZ += (value - mean(z)) * (value - mean(z)) / (z.size() - 1);
+            stringstream expected, actual;
+            raw.product(start, end, "s3", "f2", "f3", expected);
+            expected << std::fixed << std::setprecision(3) << covXY << "\n" << z.size() << "\n" << mean(z) << "\n"
+                     << *min_element(z.begin(), z.end()) << "\n" << *max_element(z.begin(), z.end()) << "\n" << varZ << "\n";
+            ASSERT_TRUE(raw.aggregate(start, end, "s3", "sum", {"f2*f3"}, actual));
+            ASSERT_TRUE(raw.aggregate(start, end, "s3", "covariance", {"f1", "f2*f3"}, actual));
+            for(const auto& func : {"count", "mean", "min", "max", "variance"})
+                ASSERT_TRUE(raw.aggregate(start, end, "s3", func, {"f1"}, actual));
+            expectSameProducts(expected.str(), actual.str());
+        }
+    }
+}
 
+TEST_F(LargeFileWriterTestSuite, rollupsMatchRawScans)
+{
+    generateInputFile(1024*512);
+    Parser raw{}, sut{};
+    EXPECT_FALSE(sut.setRollups(true, {{"f0", "f9"}}));                        //no fields yet - no phantom ones either
+    followInTwoHalves(sut, [&]{                                                 //rollups built over the first half, the second lands mid bucket
+        ASSERT_TRUE(sut.setRollups(true, {{"f0", "f9"}, {"f3", "f3"}}));
+    });
+    ASSERT_TRUE(raw.openTickFile(fileName));
+    auto compare = [&](){
+        mt19937 engine(11);
+        uniform_int_distribution<time_t> offset(0, 60000);
+        for(auto query = 0; query < 100; ++query)
+        {
+            auto start = T_STAMP + offset(engine);
+            auto end = start + offset(engine);
+            stringstream expected, actual;
+            for(const auto& fields : {make_pair("f0", "f9"), make_pair("f9", "f0"), make_pair("f3", "f3"), make_pair("f1", "f2")})
+            {
+                raw.product(start, end, "s4", fields.first, fields.second, expected);
+                sut.product(start, end, "s4", fields.first, fields.second, actual);
+            }
+            for(const auto& func : {"sum", "mean", "min", "max", "count", "variance"})
+            {
+                ASSERT_TRUE(raw.aggregate(start, end, "s4", func, {"f5"}, expected));
+                ASSERT_TRUE(sut.aggregate(start, end, "s4", func, {"f5"}, actual));
             }
+            expectSameProducts(expected.str(), actual.str());
+        }
+    };
+    compare();
+    EXPECT_GT(sut.storageBytes(), raw.storageBytes());
+    ofstream(fileName, ios::out | ios::app) << T_STAMP << ",s4,f0,1,f9,1,f5,1\n";     //out of order - s4 gets sorted, its rollup rebuilt
+    ASSERT_TRUE(sut.followTickFile(fileName));
+    ASSERT_TRUE(raw.followTickFile(fileName));
+    compare();
+}
+
+TEST_F(LargeFileWriterTestSuite, memoryBudgetSpillsAndPagesBackIn)
+{
+    generateInputFile(1024*512);
+    const size_t budget = 1u << 16;
+    Parser raw{}, sut{};
+    ASSERT_TRUE(sut.setMemoryBudget(budget, "herpDerp.spill"));
+    EXPECT_FALSE(sut.setRollups(true));                                         //refused under a budget
+    followInTwoHalves(sut, [&]{ EXPECT_LE(sut.storageBytes(), budget); });     //rows after a spill land in the tail
+    EXPECT_LE(sut.storageBytes(), budget);
+    ASSERT_TRUE(raw.openTickFile(fileName));
+    auto compare = [&](Parser& actualSut){
+        for(const auto& symbol : {"s0", "s4", "s9", "s*"})
+        {
+            stringstream expected, actual;
+            raw.print(T_STAMP, T_STAMP*2, symbol, expected);
+            actualSut.print(T_STAMP, T_STAMP*2, symbol, actual);
+            EXPECT_EQ(expected.str(), actual.str());
+            expected.str("");
+            actual.str("");
+            raw.product(T_STAMP+100, T_STAMP+20000, symbol, "f3", "f8", expected);
+            actualSut.product(T_STAMP+100, T_STAMP+20000, symbol, "f3", "f8", actual);
+            ASSERT_TRUE(raw.aggregate(T_STAMP, T_STAMP*2, symbol, "variance", {"f1"}, expected));
+            ASSERT_TRUE(actualSut.aggregate(T_STAMP, T_STAMP*2, symbol, "variance", {"f1"}, actual));
+            EXPECT_EQ(expected.str(), actual.str());
+        }
+    };
+    compare(sut);
+    ASSERT_TRUE(sut.saveSnapshot("herpDerp.snap"));
+    Parser loaded{};
+    ASSERT_TRUE(loaded.loadSnapshot("herpDerp.snap"));
+    remove("herpDerp.snap");
+    compare(loaded);
+    ASSERT_TRUE(sut.setMemoryBudget(0, ""));                                    //off - everything back in memory
+    EXPECT_GT(sut.storageBytes(), budget);
+    compare(sut);
+}
+
+TEST_F(LargeFileWriterTestSuite, spillFileReadFailureIsReported)
+{
+    generateInputFile(1024*256);
+    Parser sut{};
+    ASSERT_TRUE(sut.setMemoryBudget(1u << 16, "herpDerp.spill"));
+    ASSERT_TRUE(sut.followTickFile(fileName));
+    ASSERT_EQ(0, truncate("herpDerp.spill", 0));                                //spilled chunks gone from under the pager
+    stringstream printed, stats;
+    testing::internal::CaptureStderr();
+    sut.print(T_STAMP, T_STAMP*2, "s*", printed);
+    auto errors = testing::internal::GetCapturedStderr();
+    EXPECT_NE(string::npos, errors.find("cannot page \""));
+    testing::internal::CaptureStderr();
+    EXPECT_FALSE(sut.saveSnapshot("herpDerp.snap"));
+    testing::internal::GetCapturedStderr();
+    sut.printStats(stats);
+    EXPECT_NE(string::npos, stats.str().find("spilled tables could not be read back"));
+}
+
+TEST_F(LargeFileWriterTestSuite, spillFileGetsCompacted)
+{
+    generateInputFile(1024*256);
+    Parser raw{}, sut{};
+    ASSERT_TRUE(sut.setMemoryBudget(1u << 16, "herpDerp.spill"));
+    ASSERT_TRUE(sut.followTickFile(fileName));
+    auto spillBytes = [](){
+        struct stat info{};
+        return stat("herpDerp.spill", &info) == 0 ? static_cast<size_t>(info.st_size) : 0u;
+    };
+    auto firstSpill = spillBytes();
+    ASSERT_GT(firstSpill, 0u);
+    for(auto round = 0; round < 8; ++round)                                     //every round reorders each symbol - its chunks on disk go stale
+    {
+        ofstream out(fileName, ios::out | ios::app);
+        for(auto symbol = 0; symbol < 10; ++symbol)
+            out << T_STAMP + round << ",s" << symbol << ",f1,1,f2,2\n";
+        out.close();
+        ASSERT_TRUE(sut.followTickFile(fileName));
+    }
+    EXPECT_LT(spillBytes(), 3 * firstSpill);
+    ASSERT_TRUE(raw.openTickFile(fileName));
+    for(const auto& symbol : {"s0", "s5", "s9"})
+    {
+        stringstream expected, actual;
+        raw.print(T_STAMP, T_STAMP*2, symbol, expected);
+        raw.product(T_STAMP, T_STAMP*2, symbol, "f1", "f2", expected);
+        sut.print(T_STAMP, T_STAMP*2, symbol, actual);
+        sut.product(T_STAMP, T_STAMP*2, symbol, "f1", "f2", actual);
+        EXPECT_EQ(expected.str(), actual.str());
+    }
+}
+
+TEST(SpillTestSuite, reorderedRowsAlreadySpilledGoOutAgain)
+{
+    ofstream("herpDerp.ticks") << "10,s,a,1\n20,s,a,2\n30,s,a,3\n";
+    Parser raw{}, sut{};
+    ASSERT_TRUE(sut.setMemoryBudget(1, "herpDerp.spill"));                     //nothing stays in memory unless pinned
+    ASSERT_TRUE(sut.followTickFile("herpDerp.ticks"));
+    stringstream expected, actual;
+    sut.print(0, 100, "s", actual);                                             //paged back in whole, rows on disk too
+    ofstream("herpDerp.ticks", ios::out | ios::app) << "15,s,a,1.5\n";         //lands between rows already spilled
+    ASSERT_TRUE(sut.followTickFile("herpDerp.ticks"));
+    ASSERT_TRUE(raw.openTickFile("herpDerp.ticks"));
+    actual.str("");
+    raw.print(0, 100, "s", expected);
+    sut.print(0, 100, "s", actual);
+    EXPECT_EQ(expected.str(), actual.str());
+    remove("herpDerp.ticks");
+}
+
+TEST_F(LargeFileWriterTestSuite, outOfOrderIngestMatchesSortedInput)
+{
+    generateInputFile(1024*256);
+    vector<string> lines;
+    {
+        ifstream in(fileName);
+        for(string line; getline(in, line); )
+            lines.push_back(line);
+    }
+    mt19937 engine(3);
+    for(auto i = 0u; i + 1 < lines.size(); i += 1 + engine() % 5)              //neighbours swapped - a merged feed slightly out of order
+        swap(lines[i], lines[i + 1]);
+    swap(lines[lines.size() / 3], lines[lines.size() - 10]);                   //and one far off
+    auto timeOf = [](const string& line){ return stoll(line.substr(0, line.find(','))); };
+    auto sortedFields = [](const string& rows){
+        stringstream in(rows), out;
+        for(string row; getline(in, row); )
+        {
+            vector<string> cells;
+            stringstream cellsIn(row);
+            for(string cell; getline(cellsIn, cell, ','); )
+                cells.push_back(cell);
+            sort(cells.begin(), cells.end());
+            for(const auto& cell : cells)
+                out << cell << ",";
             out << "\n";
-            return out;
-        };
+        }
+        return out.str();
+    };
+    auto sorted = lines;
+    stable_sort(sorted.begin(), sorted.end(), [&](const string& a, const string& b){ return timeOf(a) < timeOf(b); });
+    auto writeLines = [](const string& name, const vector<string>& from, size_t first, size_t last, ios::openmode mode){
+        ofstream out(name, ios::out | mode);
+        for(auto i = first; i < last; ++i)
+            out << from[i] << "\n";
+    };
+    writeLines("herpDerp.sorted", sorted, 0, sorted.size(), ios::trunc);
+    Parser reference{}, raw{}, packed{}, budgeted{}, segmented{};
+    ASSERT_TRUE(reference.openTickFile("herpDerp.sorted"));
+    packed.setCompressedStorage(true);
+    ASSERT_TRUE(budgeted.setMemoryBudget(1u << 16, "herpDerp.spill"));
+    writeLines(fileName, lines, 0, lines.size() / 2, ios::trunc);              //in two goes - the second half reaches back into the first
+    for(auto sut : {&raw, &packed, &budgeted})
+        ASSERT_TRUE(sut->followTickFile(fileName));
+    writeLines(fileName, lines, lines.size() / 2, lines.size(), ios::app);
+    for(auto sut : {&raw, &packed, &budgeted})
+        ASSERT_TRUE(sut->followTickFile(fileName));
+    EXPECT_EQ(1u, segmented.openTickFiles(fileName));
+    for(auto sut : {&raw, &packed, &budgeted, &segmented})
+    {
+        for(const auto& symbol : {"s0", "s5"})
+        {
+            stringstream expected, actual;
+            reference.print(T_STAMP+1000, T_STAMP+9000, symbol, expected);
+            sut->print(T_STAMP+1000, T_STAMP+9000, symbol, actual);
+            EXPECT_EQ(sortedFields(expected.str()), sortedFields(actual.str()));  //fields got their ids in another order
+            expected.str("");
+            actual.str("");
+            reference.product(T_STAMP, T_STAMP*2, symbol, "f2", "f7", expected);
+            sut->product(T_STAMP, T_STAMP*2, symbol, "f2", "f7", actual);
+            expectSameProducts(expected.str(), actual.str());
+        }
+        stringstream stats;
+        sut->printStats(stats);
+        EXPECT_EQ(string::npos, stats.str().find("ingest out of order: 0 symbols")) << stats.str();
+    }
+    stringstream stats;
+    reference.printStats(stats);
+    EXPECT_NE(string::npos, stats.str().find("ingest out of order: 0 symbols sorted, 0 rows moved\n")) << stats.str();
+    remove("herpDerp.sorted");
+}
+
+TEST(CatalogTestSuite, segmentsMatchSequentialLoadsAndUnloadOneDay)
+{
+    mkdir("catalog.d", 0755);
+    vector<string> days{"catalog.d/day1.dat", "catalog.d/day2.dat", "catalog.d/day3.dat"};
+    for(auto day = 0u; day < days.size(); ++day)
+    {
+        TickGenConfig config{};
+        config.bytes = 1u << 17;
+        config.seed = day + 1;
+        config.startTime = T_STAMP + day * 86400;
+        ofstream out(days[day]);
+        generateTicks(out, config);
+    }
+    auto compare = [&](Parser& expectedSut, Parser& actualSut){
+        for(const auto& symbol : {"s0", "s4"})
+        {
+            stringstream expected, actual;
+            expectedSut.print(T_STAMP + 80000, T_STAMP + 2*86400 + 3000, symbol, expected);
+            actualSut.print(T_STAMP + 80000, T_STAMP + 2*86400 + 3000, symbol, actual);
+            EXPECT_EQ(expected.str(), actual.str());
+            expected.str("");
+            actual.str("");
+            expectedSut.product(T_STAMP, T_STAMP*2, symbol, "f1", "f2", expected);
+            actualSut.product(T_STAMP, T_STAMP*2, symbol, "f1", "f2", actual);
+            expectedSut.product(T_STAMP + 86400, T_STAMP + 86400 + 500, symbol, "f1", "f2", expected);   //day 2 only
+            actualSut.product(T_STAMP + 86400, T_STAMP + 86400 + 500, symbol, "f1", "f2", actual);
+            expectSameProducts(expected.str(), actual.str());
+        }
+    };
+    Parser sequential{};
+    for(const auto& day : days)
+        ASSERT_TRUE(sequential.openTickFile(day));
+    PrintParser sut{};
+    EXPECT_EQ(3u, sut.openTickFiles("catalog.d/day*.dat"));
+    compare(sequential, sut);
+
+    Parser withoutDay2{};
+    ASSERT_TRUE(withoutDay2.openTickFile(days[0]));
+    ASSERT_TRUE(withoutDay2.openTickFile(days[2]));
+    EXPECT_TRUE(sut.unloadTickFile(days[1]));
+    EXPECT_FALSE(sut.unloadTickFile(days[1]));
+    compare(withoutDay2, sut);
+    EXPECT_EQ(0u, sut.openTickFiles("catalog.d/nothing*"));
+    for(const auto& day : days)
+        remove(day.c_str());
+    rmdir("catalog.d");
+}
+
+TEST_F(LargeFileWriterTestSuite, symbolSetMatchesOneQueryPerSymbol)
+{
+    generateInputFile(1024*256);
+    Parser reference{};
+    ProductParser sut{};
+    sut.setQueryThreads(3);
+    ASSERT_TRUE(reference.openTickFile(fileName));
+    ASSERT_TRUE(sut.openTickFile(fileName));
+    stringstream expected, actual;
+    for(auto i = 0; i < 10; ++i)                                                //s0..s9 are in name order already
+    {
+        auto symbol = "s" + to_string(i);
+        stringstream product;
+        reference.product(T_STAMP+500, T_STAMP+30000, symbol, "f2", "f5", product);
+        if(!product.str().empty())
+            expected << symbol << " " << product.str();
+    }
+    sut.product(T_STAMP+500, T_STAMP+30000, "*", "f2", "f5", true, actual);
+    string expectedName, actualName;
+    double expectedVal, actualVal, total{0};
+    while(expected >> expectedName >> expectedVal)
+    {
+        ASSERT_TRUE(actual >> actualName >> actualVal);
+        EXPECT_EQ(expectedName, actualName);
+        EXPECT_NEAR(expectedVal, actualVal, 1.001e-3);
+        total += expectedVal;
+    }
+    ASSERT_TRUE(actual >> actualName >> actualVal);
+    EXPECT_EQ("total", actualName);
+    EXPECT_NEAR(total, actualVal, 1e-2);                                        //the expected one adds up rounded values
+    EXPECT_FALSE(actual >> actualName);
+    expected = stringstream{};
+    actual = stringstream{};
+    for(const auto& symbol : {"s7", "s3"})
+    {
+        expected << symbol << ":\n";
+        reference.print(T_STAMP+500, T_STAMP+3000, symbol, expected);
+    }
+    sut.print(T_STAMP+500, T_STAMP+3000, "s7,s3", actual);
+    EXPECT_EQ(expected.str(), actual.str());
+}
+
+TEST_F(LargeFileWriterTestSuite, productParserMatchesScalarProduct)
+{
+    generateInputFile(1024*256);
+    Parser scalar{};
+    ProductParser sut{};
+    sut.setProductThreads(3);
+    ASSERT_TRUE(scalar.openTickFile(fileName));
+    ASSERT_TRUE(sut.openTickFile(fileName));
+    for(const auto& symbol : {"s0", "s5"})
+        for(const auto& fields : {make_pair("f0", "f1"), make_pair("f2", "f9"), make_pair("f4", "f4")})
+        {
+            testing::internal::CaptureStdout();
+            scalar.product(T_STAMP, T_STAMP*2, symbol, fields.first, fields.second);
+            scalar.product(T_STAMP+500, T_STAMP+3000, symbol, fields.first, fields.second);
+            auto expected = testing::internal::GetCapturedStdout();
+            testing::internal::CaptureStdout();
+            sut.product(T_STAMP, T_STAMP*2, symbol, fields.first, fields.second);
+            sut.product(T_STAMP+500, T_STAMP+3000, symbol, fields.first, fields.second);
+            expectSameProducts(expected, testing::internal::GetCapturedStdout());
+        }
+}
+
+TEST_F(LargeFileWriterTestSuite, productKernelStaysOnThePoolWorker)
+{
+    generateInputFile(1024*256);
+    ProductParser sut{};
+    sut.setProductThreads(3);
+    ASSERT_TRUE(sut.openTickFile(fileName));
+    stringstream expected, actual;
+    sut.product(T_STAMP, T_STAMP*2, "s0", "f0", "f1", expected);
+    ThreadPool pool(2);
+    EXPECT_FALSE(ThreadPool::onWorker());
+    EXPECT_TRUE(pool.submit([](){ return ThreadPool::onWorker(); }).get());  //the kernel runs serially there
+    pool.submit([&](){ sut.product(T_STAMP, T_STAMP*2, "s0", "f0", "f1", actual); }).get();
+    expectSameProducts(expected.str(), actual.str());
+}
+
+TEST_F(LargeFileWriterTestSuite, printParserOutputIsByteIdentical)
+{
+    generateInputFile(1024*256);
+    Parser reference{};
+    PrintParser sut{};
+    sut.setPrintThreads(3);
+    ASSERT_TRUE(reference.openTickFile(fileName));
+    ASSERT_TRUE(sut.openTickFile(fileName));
+    for(const auto& symbol : {"s1", "s8"})
+    {
+        testing::internal::CaptureStdout();
+        reference.print(T_STAMP, T_STAMP*2, symbol);
+        reference.print(T_STAMP+500, T_STAMP+3000, symbol);
+        auto expected = testing::internal::GetCapturedStdout();
+        testing::internal::CaptureStdout();
+        sut.print(T_STAMP, T_STAMP*2, symbol);
+        sut.print(T_STAMP+500, T_STAMP+3000, symbol);
+        EXPECT_EQ(expected, testing::internal::GetCapturedStdout());
+    }
+}
+
+TEST_F(LargeFileWriterTestSuite, cachedPrefixSumsMatchDirectProduct)
+{
+    generateInputFile(1024*256);
+    Parser reference{};
+    Parser sut{};
+    sut.setPrefixSumBudget(1u << 20);
+    ASSERT_TRUE(reference.openTickFile(fileName));
+    ASSERT_TRUE(sut.openTickFile(fileName));
+    mt19937 engine(3);
+    uniform_int_distribution<time_t> offset(0, 30000);
+    for(auto query = 0; query < 200; ++query)
+    {
+        auto start = T_STAMP + offset(engine);
+        auto end = start + offset(engine);
+        testing::internal::CaptureStdout();
+        reference.product(start, end, "s2", "f3", "f1");
+        reference.product(start, end, "s2", "f1", "f3");
+        auto expected = testing::internal::GetCapturedStdout();
+        testing::internal::CaptureStdout();
+        sut.product(start, end, "s2", "f3", "f1");
+        sut.product(start, end, "s2", "f1", "f3");
+        expectSameProducts(expected, testing::internal::GetCapturedStdout());
+    }
+}
+
+TEST_F(GenericParserTestSuite, cachedPrefixSumsFollowAppendedRows)
+{
+    Parser sut{};
+    sut.setPrefixSumBudget(1u << 20);
+    ASSERT_TRUE(sut.openTickFile(fileName));
+    testing::internal::CaptureStdout();
+    sut.product(T_STAMP-1, T_STAMP+21, "s1", "f1", "f2");
+    ASSERT_TRUE(sut.openTickFile(fileName));                                    //same rows once more behind the first ones
+    sut.product(T_STAMP-1, T_STAMP+21, "s1", "f1", "f2");
+    EXPECT_EQ("124.000\n248.000\n", testing::internal::GetCapturedStdout());
+}
+
+TEST(PrefixSumCacheTestSuite, evictsLeastRecentlyUsedWithinBudget)
+{
+    SymbolTable table{};
+    for(auto row = 0u; row < 100; ++row)
+    {
+        table.timestamps.push_back(T_STAMP + row);
+        table.set(row, 0, row);
+        table.set(row, 1, 2.0);
+        if(row % 2)
+            table.set(row, 2, 1.0);
+    }
+    PrefixSumCache sut{};
+    sut.setBudget(2 * 2 * sizeof(double) * 101);                                //room for exactly two entries
+    double product{0};
+    ASSERT_TRUE(sut.rangeProduct(0, 0, 1, table.columns[0], table.columns[1], 100, ::Range{10, 20}, product));
+    EXPECT_DOUBLE_EQ(290.0, product);
+    ASSERT_TRUE(sut.rangeProduct(0, 0, 2, table.columns[0], table.columns[2], 100, ::Range{10, 20}, product));
+    EXPECT_DOUBLE_EQ(75.0, product);
+    ASSERT_TRUE(sut.rangeProduct(0, 1, 0, table.columns[1], table.columns[0], 100, ::Range{0, 100}, product));  //hit, now most recent
+    EXPECT_DOUBLE_EQ(9900.0, product);
+    ASSERT_TRUE(sut.rangeProduct(0, 1, 2, table.columns[1], table.columns[2], 100, ::Range{0, 4}, product));    //evicts a*c
+    EXPECT_DOUBLE_EQ(4.0, product);
+    EXPECT_EQ(2 * 2 * sizeof(double) * 101, sut.usedBytes());
+    sut.setBudget(2 * sizeof(double) * 50);                                     //too small for any entry - callers get to scan
+    EXPECT_EQ(0u, sut.usedBytes());
+    EXPECT_FALSE(sut.rangeProduct(0, 0, 1, table.columns[0], table.columns[1], 100, ::Range{10, 20}, product));
+}
+
+TEST(PrefixSumCacheTestSuite, budgetChangesWhileQueriesRun)
+{
+    SymbolTable table{};
+    for(auto row = 0u; row < 100; ++row)
+    {
+        table.timestamps.push_back(T_STAMP + row);
+        table.set(row, 0, row);
+        table.set(row, 1, 2.0);
+    }
+    PrefixSumCache sut{};
+    atomic<unsigned> wrong{0};
+    vector<thread> readers;
+    for(auto r = 0; r < 3; ++r)
+        readers.emplace_back([&](){
+            for(auto query = 0; query < 2000; ++query)                          //either a cache hit with the right sum or a miss
+            {
+                double product{0};
+                if(sut.rangeProduct(0, 0, 1, table.columns[0], table.columns[1], 100, ::Range{10, 20}, product) && (product != 290.0))
+                    ++wrong;
+                sut.usedBytes();
+            }
+        });
+    for(auto toggle = 0; toggle < 2000; ++toggle)
+        sut.setBudget(toggle % 2 ? 0u : 1u << 20);
+    for(auto& reader : readers)
+        reader.join();
+    EXPECT_EQ(0u, wrong.load());
+}
 
-        while((int)byteCount > 0)
+TEST(InternerTestSuite, handsOutDenseIdsInOrderOfFirstAppearance)
+{
+    Interner sut{};
+    vector<string> names;
+    for(auto i = 0u; i < 1000; ++i)                                             //enough to make it grow a few times
+        names.push_back("sym" + to_string(i));
+    for(auto i = 0u; i < names.size(); ++i)
+        ASSERT_EQ(i, sut.intern(names[i].data(), names[i].size()));
+    for(auto i = 0u; i < names.size(); ++i)
+    {
+        EXPECT_EQ(i, sut.intern(names[i]));
+        EXPECT_EQ(i, sut.find(names[i]));
+        EXPECT_EQ(names[i], sut.name(i));
+    }
+    EXPECT_EQ(names.size(), sut.size());
+    EXPECT_EQ(Interner::NONE, sut.find("sym1000"));
+    EXPECT_EQ(Interner::NONE, Interner{}.find("sym0"));
+}
+
+TEST_F(LargeFileWriterTestSuite, snapshotRoundTripGivesIdenticalResults)
+{
+    generateInputFile(1024*64);
+    Parser reference{};
+    ASSERT_TRUE(reference.openTickFile(fileName));
+    ASSERT_TRUE(reference.saveSnapshot("herpDerp.snap"));
+    Parser sut{};
+    ASSERT_TRUE(sut.loadSnapshot("herpDerp.snap"));
+    remove("herpDerp.snap");
+    for(const auto& symbol : {"s0", "s7"})
+    {
+        testing::internal::CaptureStdout();
+        reference.print(T_STAMP, T_STAMP*2, symbol);
+        reference.product(T_STAMP+100, T_STAMP+2000, symbol, "f3", "f8");
+        auto expected = testing::internal::GetCapturedStdout();
+        testing::internal::CaptureStdout();
+        sut.print(T_STAMP, T_STAMP*2, symbol);
+        sut.product(T_STAMP+100, T_STAMP+2000, symbol, "f3", "f8");
+        EXPECT_EQ(expected, testing::internal::GetCapturedStdout());
+    }
+}
+
+TEST_F(GenericParserTestSuite, outOfOrderSnapshotGetsSortedOnLoad)
+{
+    TickData unsorted{};
+    stringstream lines;
+    lines << T_STAMP+20 << ",s1,f1,3\n" << T_STAMP << ",s1,f1,1,f2,2\n" << T_STAMP+10 << ",s1,f2,4\n";
+    TickReader(unsorted).readLines(lines);
+    ASSERT_TRUE(writeSnapshot(unsorted, "herpDerp.snap"));                     //tables as they came in, the loader indexes them unsorted
+    Parser sut{};
+    ASSERT_TRUE(sut.loadSnapshot("herpDerp.snap"));
+    remove("herpDerp.snap");
+    stringstream printed, stats;
+    sut.print(T_STAMP, T_STAMP+30, "s1", printed);
+    sut.print(T_STAMP+5, T_STAMP+15, "s1", printed);
+    EXPECT_EQ("f1:1.000,f2:2.000\nf2:4.000\nf1:3.000\nf2:4.000\n", printed.str());
+    sut.printStats(stats);
+    EXPECT_NE(string::npos, stats.str().find("ingest out of order: 1 symbols sorted, 3 rows moved"));
+}
+
+struct SnapshotDamage
+{
+    size_t offset;                                                              //byte to scribble on, counted from the end when 'fromEnd'
+    bool fromEnd;
+    size_t truncateBy;
+    SnapshotStatus expectation;
+};
+
+struct SnapshotDamageParamTestSuite : GenericParserTestSuite,
+                                      WithParamInterface<SnapshotDamage>
+{};
+
+INSTANTIATE_TEST_CASE_P(SnapshotTest, SnapshotDamageParamTestSuite,
+                        Values(SnapshotDamage{0, false, 0, SnapshotStatus::ok},
+                               SnapshotDamage{1, false, 0, SnapshotStatus::notASnapshot},
+                               SnapshotDamage{8, false, 0, SnapshotStatus::versionMismatch},
+                               SnapshotDamage{40, false, 0, SnapshotStatus::corrupt},
+                               SnapshotDamage{3, true, 0, SnapshotStatus::corrupt},
+                               SnapshotDamage{0, false, 8, SnapshotStatus::corrupt}));
+
+TEST_P(SnapshotDamageParamTestSuite, detectsDamagedSnapshots)
+{
+    auto param = GetParam();
+    Parser source{};
+    ASSERT_TRUE(source.openTickFile(fileName));
+    ASSERT_TRUE(source.saveSnapshot("herpDerp.snap"));
+    string bytes;
+    {
+        ifstream in("herpDerp.snap", ios::binary);
+        bytes.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    }
+    if(param.offset || param.fromEnd)
+        bytes[param.fromEnd ? bytes.size() - param.offset : param.offset] ^= 0x5a;
+    bytes.resize(bytes.size() - param.truncateBy);
+    {
+        ofstream out("herpDerp.snap", ios::binary | ios::trunc);
+        out << bytes;
+    }
+    TickData tick{};
+    EXPECT_EQ(param.expectation, readSnapshot(tick, "herpDerp.snap"));
+
+    Parser sut{};
+    ASSERT_TRUE(sut.openTickFile(fileName));
+    EXPECT_EQ(param.expectation == SnapshotStatus::ok, sut.loadSnapshot("herpDerp.snap"));
+    remove("herpDerp.snap");
+    testing::internal::CaptureStdout();
+    sut.product(T_STAMP-1, T_STAMP+11, "s1", "f1", "f2");                       //whatever happened, the data is still there
+    EXPECT_EQ("124.000\n", testing::internal::GetCapturedStdout());
+}
+
+TEST_F(LargeFileWriterTestSuite, batchOutputKeepsInputOrder)
+{
+    generateInputFile(1024*64);
+    stringstream commands, expected;
+    Parser reference{};
+    ASSERT_TRUE(reference.openTickFile(fileName));
+    commands << "tickfile " << fileName << "\n\n";
+    for(auto i = 0; i < 300; ++i)
+    {
+        auto symbol = "s" + to_string(i % 10);
+        commands << "print " << T_STAMP + i * 10 << " " << T_STAMP + i * 40 << " " << symbol << "\n"
+                 << "product " << T_STAMP << " " << T_STAMP + i * 100 << " " << symbol << " f1 f2\n";
+        reference.print(T_STAMP + i * 10, T_STAMP + i * 40, symbol, expected);
+        reference.product(T_STAMP, T_STAMP + i * 100, symbol, "f1", "f2", expected);
+    }
+    Parser sut{};
+    stringstream output;
+    auto stats = BatchRunner(sut, output, 4).run(commands);
+    EXPECT_EQ(600u, stats.queries);
+    EXPECT_EQ(expected.str().size(), stats.outputBytes);
+    EXPECT_EQ(expected.str(), output.str());
+}
+
+TEST_F(GenericParserTestSuite, batchTickfileIsABarrier)
+{
+    stringstream commands;
+    commands << "product " << T_STAMP-1 << " " << T_STAMP+11 << " s1 f1 f2\n"     //nothing loaded yet - no output
+             << "tickfile " << fileName << "\n"
+             << "product " << T_STAMP-1 << " " << T_STAMP+11 << " s1 f1 f2\n"
+             << "tickfile " << fileName << "\n"
+             << "product " << T_STAMP-1 << " " << T_STAMP+21 << " s1 f1 f2\n";
+    PrintParser sut{};
+    stringstream output;
+    BatchRunner(sut, output, 2).run(commands);
+    EXPECT_EQ("124.000\n248.000\n", output.str());
+}
+
+class SocketClient
+{
+public:
+    explicit SocketClient(const string& path) : fd(socket(AF_UNIX, SOCK_STREAM, 0))
+    {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+        connected = connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+    }
+    ~SocketClient()
+    {
+        close(fd);
+    }
+    string ask(const string& command)                                           //the reply up to & including its status line
+    {
+        auto line = command + "\n";
+        if(!connected || (send(fd, line.data(), line.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(line.size())))
+            return "not connected";
+        string reply;
+        while(true)
         {
-            time += randTime(randIntEngine);
-            auto line = generateLine();
-            outFile << line.str();
-            byteCount -= line.str().size();
+            auto eol = pending.find('\n');
+            if(eol != string::npos)
+            {
+                auto replyLine = pending.substr(0, eol + 1);
+                pending.erase(0, eol + 1);
+                reply += replyLine;
+                if((replyLine.compare(0, 3, "ok ") == 0) || (replyLine.compare(0, 4, "err ") == 0))
+                    return reply;
+                continue;
+            }
+            char chunk[4096];
+            auto received = recv(fd, chunk, sizeof(chunk), 0);
+            if(received <= 0)
+                return reply + "disconnected";
+            pending.append(chunk, static_cast<size_t>(received));
         }
     }
+    bool connected{false};
+private:
+    int fd;
+    string pending;
+};
+
+struct QueryServerTestSuite : GenericParserTestSuite
+{
+    const string socketPath{"gs_test.sock"};
+    QueryServer server{[](){ return unique_ptr<Parser>(new Parser()); }};
+    thread acceptor;
+    void SetUp() override
+    {
+        GenericParserTestSuite::SetUp();
+        ASSERT_TRUE(server.listen(socketPath));
+        acceptor = thread([this](){ server.run(); });
+    }
+    void TearDown() override
+    {
+        server.stop();
+        if(acceptor.joinable())
+            acceptor.join();
+        GenericParserTestSuite::TearDown();
+    }
 };
 
+TEST_F(QueryServerTestSuite, publishesVersionsWithoutTouchingHeldOnes)
+{
+    SocketClient loader(socketPath), analyst(socketPath);
+    ASSERT_TRUE(loader.connected && analyst.connected);
+    auto range = " " + to_string(T_STAMP) + " " + to_string(T_STAMP+40) + " ";
+    EXPECT_EQ("ok 0\n", analyst.ask("print" + range + "s1"));
+    EXPECT_EQ("ok 1\n", loader.ask("follow " + fileName));
+    EXPECT_EQ("124.000\nok 1\n", analyst.ask("product" + range + "s1 f1 f2"));
+    auto held = server.snapshot();
+    ofstream(fileName, ios::out | ios::app) << T_STAMP+30 << ",s1,f1,1,f2,2\n";
+    EXPECT_EQ("ok 2\n", loader.ask("follow " + fileName));
+    EXPECT_EQ("126.000\nok 2\n", analyst.ask("product" + range + "s1 f1 f2"));
+    EXPECT_EQ("s1 126.000\ns2 40.000\ntotal 166.000\nok 2\n", analyst.ask("product" + range + "* f1 f2 total"));
+    EXPECT_EQ("2.000\nok 2\n", analyst.ask("agg min" + range + "s1 f2"));
+    stringstream old;
+    held->parser->product(T_STAMP, T_STAMP+40, "s1", "f1", "f2", old);        //the version in hand doesn't see the new row
+    EXPECT_EQ("124.000\n", old.str());
+    EXPECT_EQ("err follow failed\n", loader.ask("follow no_such.dat"));
+    EXPECT_EQ("err nope\n", analyst.ask("bogus"));
+    EXPECT_EQ("ok 2\n", analyst.ask("version"));
+}
+
+TEST_F(QueryServerTestSuite, settingsPublishAndOverlongLinesDropTheClient)
+{
+    SocketClient loader(socketPath), flooder(socketPath);
+    ASSERT_TRUE(loader.connected && flooder.connected);
+    auto range = " " + to_string(T_STAMP) + " " + to_string(T_STAMP+40) + " ";
+    EXPECT_EQ("ok 1\n", loader.ask("tickfile " + fileName));
+    EXPECT_EQ("ok 2\n", loader.ask("rollup on f1*f2"));
+    EXPECT_EQ("ok 3\n", loader.ask("prefixsums 1"));
+    EXPECT_EQ("124.000\nok 3\n", loader.ask("product" + range + "s1 f1 f2"));
+    EXPECT_EQ("ok 3\n", loader.ask("save gs_test.snap"));
+    Parser loaded{};
+    ASSERT_TRUE(loaded.loadSnapshot("gs_test.snap"));
+    remove("gs_test.snap");
+    stringstream products;
+    loaded.product(T_STAMP, T_STAMP+40, "s1", "f1", "f2", products);
+    EXPECT_EQ("124.000\n", products.str());
+    EXPECT_EQ("err nope\n", loader.ask("rollup maybe"));
+    EXPECT_EQ("err rollup failed\n", loader.ask("rollup on f1*nope"));
+    EXPECT_EQ("err line too long\n", flooder.ask(string(QueryServer::MAX_LINE + 1, 'x')));
+    EXPECT_EQ(string::npos, flooder.ask("version").find("ok "));
+    EXPECT_EQ("ok 3\n", loader.ask("version"));
+}
+
+TEST_F(QueryServerTestSuite, readersRunWhileVersionsArePublished)
+{
+    SocketClient loader(socketPath);
+    ASSERT_EQ("ok 1\n", loader.ask("tickfile " + fileName));
+    atomic<unsigned> consistent{0};
+    vector<thread> analysts;
+    for(auto a = 0; a < 4; ++a)
+        analysts.emplace_back([&](){
+            SocketClient analyst(socketPath);
+            for(auto query = 0; query < 50; ++query)                            //every version has s1 at 124 plus 2 per appended row
+            {
+                stringstream reply(analyst.ask("product " + to_string(T_STAMP) + " " + to_string(T_STAMP*2) + " s1 f1 f2"));
+                double product;
+                string status;
+                if((reply >> product >> status) && (status == "ok") && (fmod(product - 124.0, 2.0) == 0.0))
+                    ++consistent;
+            }
+        });
+    for(auto row = 0; row < 10; ++row)
+    {
+        ofstream(fileName, ios::out | ios::app) << T_STAMP+100+row << ",s1,f1,1,f2,2\n";
+        EXPECT_EQ("ok " + to_string(row + 2) + "\n", loader.ask("follow " + fileName));
+    }
+    for(auto& analyst : analysts)
+        analyst.join();
+    EXPECT_EQ(200u, consistent.load());
+    EXPECT_EQ("144.000\nok 11\n", loader.ask("product " + to_string(T_STAMP) + " " + to_string(T_STAMP*2) + " s1 f1 f2"));
+}
+
+TEST_F(GenericParserTestSuite, versionCopySharesUntouchedSymbols)
+{
+    struct Version : Parser
+    {
+        using Parser::findTable;
+    };
+    Version base{}, next{};
+    ASSERT_TRUE(base.followTickFile(fileName));
+    stringstream products, stats;
+    base.product(T_STAMP, T_STAMP+40, "s1", "f1", "f2", products);
+    next.copyDataFrom(base);
+    EXPECT_EQ(base.findTable("s1"), next.findTable("s1"));
+    ofstream(fileName, ios::out | ios::app) << T_STAMP+30 << ",s1,f1,1,f2,2\n";
+    ASSERT_TRUE(next.followTickFile(fileName));
+    EXPECT_NE(base.findTable("s1"), next.findTable("s1"));                     //copied on the append...
+    EXPECT_EQ(base.findTable("s2"), next.findTable("s2"));                     //...the rest still shared
+    base.product(T_STAMP, T_STAMP+40, "s1", "f1", "f2", products);
+    next.product(T_STAMP, T_STAMP+40, "s1", "f1", "f2", products);
+    EXPECT_EQ("124.000\n124.000\n126.000\n", products.str());
+    next.printStats(stats);
+    EXPECT_NE(string::npos, stats.str().find("product: 2 calls"));             //the one made on base carried over
+}
+
+TEST_F(GenericParserTestSuite, parallelIngestKeepsFieldOrderOfFirstAppearance)
+{
+    outFile = ofstream(fileName, ios::out | ios::trunc);
+    outFile << T_STAMP   << ",s1,f1,1\n" << T_STAMP+1 << ",s2,f2,2,f1,3\n"
+            << T_STAMP+2 << ",s1,f3,4,f2,5\n" << T_STAMP+3 << ",s1,f1,6,f3,7\n";
+    outFile.close();
+    Parser sut{};
+    sut.setIngestThreads(4);
+    ASSERT_TRUE(sut.openTickFile(fileName));
+    testing::internal::CaptureStdout();
+    sut.print(T_STAMP, T_STAMP+4, "s1");
+    sut.print(T_STAMP, T_STAMP+4, "s2");
+    EXPECT_EQ("f1:1.000\nf2:5.000,f3:4.000\nf1:6.000,f3:7.000\nf1:3.000,f2:2.000\n", testing::internal::GetCapturedStdout());
+}
+
+TEST_F(GenericParserTestSuite, ingestAllocationsDoNotGrowWithRows)
+{
+    generateInputFile();
+    size_t allocations[2];
+    for(auto pass = 0u; pass < 2; ++pass)                                       //the second file has 16x the rows of the first
+    {
+        outFile = ofstream(fileName, ios::out | ios::trunc);
+        for(auto row = 0u; row < (pass ? 64000u : 4000u); ++row)
+            outFile << T_STAMP + row << ",s" << row % 4 << ",f1," << row << (row % 3 ? ",f2,1.5" : "") << "\n";
+        outFile.close();
+        for(auto threads : {1u, 4u})
+        {
+            Parser sut{};
+            sut.setIngestThreads(threads);
+            auto before = allocationCount.load();
+            ASSERT_TRUE(sut.openTickFile(fileName));
+            allocations[pass] = allocationCount.load() - before;
+        }
+    }
+    EXPECT_LT(allocations[0], 1000u);                                           //nothing per row - only the geometric growth of the columns
+    EXPECT_LT(allocations[1], 2 * allocations[0]);
+}
+
 struct LargeInputFileParserParametricPerformanceTestSuite : LargeFileWriterTestSuite,
                                                             WithParamInterface<PerfParam>
 {
@@ -296,24 +1751,44 @@ TEST_P(LargeInputFileParserParametricPerformanceTestSuite, performLargePrintsTes
     generateInputFile(param.fileSize);
 
     Parser sut{};
-    auto readStart = std::chrono::system_clock::now();
+    auto readStart = std::chrono::steady_clock::now();
     ASSERT_TRUE(sut.openTickFile("perf.dat"));
-    auto readEnd = std::chrono::system_clock::now();
+    auto readEnd = std::chrono::steady_clock::now();
     auto readTime = std::chrono::duration_cast<std::chrono::nanoseconds>(readEnd - readStart);
 
-    auto printStart = std::chrono::system_clock::now();
+    auto printStart = std::chrono::steady_clock::now();
     sut.print(param.rangeStart, param.rangeEnd, param.symbol);
-    auto printEnd = std::chrono::system_clock::now();
+    auto printEnd = std::chrono::steady_clock::now();
     auto printTime = std::chrono::duration_cast<std::chrono::nanoseconds>(printEnd - printStart);
 
-    auto productStart = std::chrono::system_clock::now();
+    auto productStart = std::chrono::steady_clock::now();
     sut.product(param.rangeStart, param.rangeEnd, param.symbol, param.field1, param.field2);
-    auto productEnd = std::chrono::system_clock::now();
+    auto productEnd = std::chrono::steady_clock::now();
     auto productTime = std::chrono::duration_cast<std::chrono::nanoseconds>(productEnd - productStart);
 
     cerr << param.fileSize << "\t" << readTime.count() << "\t" << printTime.count() << "\t" << productTime.count() << endl;
 }
 
+TEST_P(LargeInputFileParserParametricPerformanceTestSuite, measureParallelIngestThroughput)
+{
+    fileName = "perf.dat";
+    auto param = GetParam();
+    generateInputFile(param.fileSize);
+
+    ofstream throughput("throughput.out", ios::out | ios::app);                //file size, thread count, MB/s, allocations, peak RSS [kiB]
+    for(auto threads = 1u; threads <= max(4u, thread::hardware_concurrency()); threads *= 2)
+    {
+        Parser sut{};
+        sut.setIngestThreads(threads);
+        auto allocationsBefore = allocationCount.load();
+        auto readStart = std::chrono::steady_clock::now();
+        ASSERT_TRUE(sut.openTickFile("perf.dat"));
+        auto readTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - readStart);
+        throughput << param.fileSize << "\t" << threads << "\t" << param.fileSize / readTime.count() / 1e6
+                   << "\t" << allocationCount.load() - allocationsBefore << "\t" << peakRssKiB() << endl;
+    }
+}
+
 int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
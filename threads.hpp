@@ -0,0 +1,100 @@
+#pragma once
+#include <thread>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+inline unsigned defaultThreadCount()
+{
+    auto count = std::thread::hardware_concurrency();                           //allowed to return 0 when it has no clue
+    return count ? count : 1u;
+}
+
+template<typename Func>
+void parallelFor(unsigned count, Func&& func)                                  //runs func(0) ... func(count-1) concurrently, the calling thread takes index 0
+{
+    std::vector<std::thread> workers;
+    workers.reserve(count);
+    for(auto i = 1u; i < count; ++i)
+        workers.emplace_back([&func, i](){ func(i); });
+    if(count > 0)
+        func(0u);
+    for(auto& worker : workers)
+        worker.join();
+}
+
+class ThreadPool                                                                //fixed set of workers for a stream of independent tasks, results come back as futures
+{
+public:
+    explicit ThreadPool(unsigned threads = defaultThreadCount())
+    {
+        for(auto i = 0u; i < threads; ++i)
+            workers.emplace_back([this](){ work(); });
+    }
+    ~ThreadPool()                                                               //whatever was submitted still gets done
+    {
+        {
+            std::lock_guard<std::mutex> lock(guard);
+            stopping = true;
+        }
+        wake.notify_all();
+        for(auto& worker : workers)
+            worker.join();
+    }
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    template<typename Func>
+    auto submit(Func&& func) -> std::future<decltype(func())>
+    {
+        auto task = std::make_shared<std::packaged_task<decltype(func())()>>(std::forward<Func>(func));     //std::function wants copyable callables
+        auto result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(guard);
+            tasks.emplace_back([task](){ (*task)(); });
+        }
+        wake.notify_one();
+        return result;
+    }
+    unsigned size() const
+    {
+        return static_cast<unsigned>(workers.size());
+    }
+    static bool onWorker()                                                      //true on a thread of any pool - work there is parallel already, don't split it further
+    {
+        return workerFlag();
+    }
+private:
+    static bool& workerFlag()
+    {
+        thread_local bool flag{false};
+        return flag;
+    }
+    void work()
+    {
+        workerFlag() = true;
+        while(true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(guard);
+                wake.wait(lock, [this](){ return stopping || !tasks.empty(); });
+                if(tasks.empty())
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex guard;
+    std::condition_variable wake;
+    bool stopping{false};
+};
@@ -0,0 +1,57 @@
+#pragma once
+#include <string>
+#include <ostream>
+#include <random>
+#include <cstdint>
+#include <ctime>
+#include "format.hpp"
+
+/* Seeded tick file generator shared by the tests and the benchmarks - the same config gives the same bytes on every run.
+ * Only the raw engine output is used (no std:: distributions, their results differ between standard libraries), so the
+ * files are reproducible across toolchains as well. Symbols are s0..s<symbols-1>, fields f0..f<fields-1>.
+ */
+struct TickGenConfig
+{
+    size_t bytes{1u << 20};                                                     //generation stops at the first line boundary past this
+    unsigned symbols{10};
+    unsigned fields{10};
+    double fieldDensity{0.5};                                                   //chance of each field being on a line, every line carries at least one
+    unsigned maxTimeStep{20};                                                   //timestamps advance by 0..maxTimeStep per line
+    time_t startTime{1570289783};
+    uint64_t seed{1};
+};
+
+inline size_t generateTicks(std::ostream& out, const TickGenConfig& config)    //returns the number of lines written
+{
+    std::mt19937_64 engine(config.seed);
+    auto below = [&](uint64_t bound){ return static_cast<unsigned>(engine() % bound); };
+    auto unit = [&](){ return static_cast<double>(engine() >> 11) / 9007199254740992.0; };     //53 random bits in [0, 1)
+    auto time = config.startTime;
+    std::string buffer;
+    size_t written{0}, lines{0};
+    while(written < config.bytes)
+    {
+        buffer.clear();
+        for(auto i = 0u; (i < 1024u) && (written + buffer.size() < config.bytes); ++i, ++lines)
+        {
+            time += below(config.maxTimeStep + 1u);
+            buffer += std::to_string(time);
+            buffer += ",s";
+            buffer += std::to_string(below(config.symbols));
+            auto forced = below(config.fields);                                 //keeps the line from ending up with no fields at all
+            for(auto field = 0u; field < config.fields; ++field)
+            {
+                if((field != forced) && !(unit() < config.fieldDensity))
+                    continue;
+                buffer += ",f";
+                buffer += std::to_string(field);
+                buffer += ',';
+                appendFixed3(buffer, unit() * 30.0);
+            }
+            buffer += '\n';
+        }
+        out.write(buffer.data(), buffer.size());
+        written += buffer.size();
+    }
+    return lines;
+}